@@ -66,11 +66,26 @@
 
 #include <ctype.h>
 #include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#ifdef TXTELITE_THREADS
+# include <pthread.h>
+# include <unistd.h>
+#endif /* ifdef TXTELITE_THREADS */
+
+#ifdef TXTELITE_WRITEV
+# include <errno.h>
+# include <sys/types.h>
+# include <sys/uio.h>
+# include <unistd.h>
+#endif /* ifdef TXTELITE_WRITEV */
+
+#include "txtelite.h"
+
 #define true  (-1)
 #define false  (0)
 #define tonnes (0)
@@ -118,20 +133,73 @@ typedef struct {
     char name[12];
 } plansys;
 
-static void goat_soup(const char *source, plansys *psy);
-
 #define galsize    (256)
+#define numgalaxies  (8)
 #define AlienItems  (16)
 #define numforLave    7 /* Lave is 7th generated planet in galaxy one */
 #define lasttrade AlienItems
 
-static plansys galaxy[galsize]; /* Need 0 to galsize-1 inclusive */
+#define namelen (9) /* Longest name is four pairs */
+
+/*
+ * A galaxy is kept as a structure of arrays rather than
+ * an array of plansys, so that a scan over positions or
+ * economies only touches the bytes it needs.  Attributes
+ * are stored at their natural width.  Use unpacksystem()
+ * to get a plansys for any one system.
+ */
+
+typedef struct {
+    uint8 x[galsize]; /* Need 0 to galsize-1 inclusive */
+    uint8 y[galsize];
+    uint8 economy[galsize];
+    uint8 govtype[galsize];
+    uint8 techlev[galsize];
+    uint8 population[galsize];
+    uint16 productivity[galsize];
+    uint16 radius[galsize];
+    uint8 human_colony[galsize];
+    uint8 species_type[galsize];
+    uint8 species_adj1[galsize];
+    uint8 species_adj2[galsize];
+    uint8 species_adj3[galsize];
+    fastseedtype goatsoupseed[galsize];
+    char name[galsize][namelen];
+} galaxytype;
+
+/*
+ * Uniform grid over a galaxy for range and nearest queries.
+ * Distance weighs X twice as heavily as Y, so cells are
+ * twice as tall as they are wide.  Systems in cell c are
+ * item[start[c]] to item[start[c+1]-1], in index order.
+ */
 
-static seedtype seed;
+#define cellw (16) /* X units per cell */
+#define cellh (32) /* Y units per cell */
+#define gridw (256 / cellw)
+#define gridh (256 / cellh)
 
-static fastseedtype rnd_seed;
+typedef struct {
+    uint16 start[gridw * gridh + 1];
+    uint16 item[galsize];
+} gridtype;
+
+/*
+ * Jump graph of a galaxy in compressed sparse row form.
+ * The systems within range of system i (other than i) are
+ * adj[start[i]] to adj[start[i+1]-1], in index order, at
+ * distances dist[start[i]] onwards.  Systems reachable
+ * from one another share a component, labelled by its
+ * lowest numbered system.
+ */
 
-static boolean nativerand;
+typedef struct {
+    uint16 start[galsize + 1];
+    uint16 *dist; /* One allocation holds dist then adj */
+    uint8 *adj;
+    uint8 comp[galsize];      /* Component of each system */
+    uint16 compsize[galsize]; /* Systems in each component, by label */
+} graphtype;
 
 typedef struct {       /* In 6502 version these were: */
     myuint baseprice;  /* one byte */
@@ -147,14 +215,190 @@ typedef struct {
     myuint price[lasttrade + 1];
 } markettype;
 
-/* Player workspace */
-static myuint shipshold[lasttrade + 1]; /* Contents of cargo bay */
-static planetnum currentplanet;         /* Current planet */
-static myuint galaxynum;                /* Galaxy number (1-8) */
-static int32 cash;
-static myuint fuel;
-static markettype localmarket;
-static myuint holdspace;
+#define numeconomies (8)
+
+/*
+ * Every market there can be: prices and quantities depend
+ * only on economy and fluctuation byte.  The fluctuation
+ * byte varies fastest, so the generator vectorises and a
+ * scan over fluctuations reads contiguous memory.
+ */
+
+typedef struct {
+    uint16 price[numeconomies][lasttrade + 1][256];
+    uint8 quantity[numeconomies][lasttrade + 1][256];
+    markettype typical[numeconomies]; /* Mean over fluctuations */
+    uint16 arbprofit[numeconomies][numeconomies]; /* Best per tonne from one typical market to another */
+    uint8 arbgood[numeconomies][numeconomies];    /* and the good that makes it */
+} marketcube;
+
+#ifdef TXTELITE_THREADS
+typedef pthread_mutex_t locktype;
+#else
+typedef int locktype;
+#endif /* ifdef TXTELITE_THREADS */
+
+#define hopsroute (TXTELITE_HOPS) /* Fewest jumps, then least fuel */
+#define fuelroute (TXTELITE_FUEL) /* Least fuel, then fewest jumps */
+
+/*
+ * All-pairs routes of a galaxy: next[to][from] is the
+ * system after from on the way to to; from itself if
+ * to cannot be reached.
+ */
+
+typedef struct {
+    uint8 next[galsize][galsize];
+} routetype;
+
+/*
+ * Best profit per tonne from a single good carried
+ * between each ordered pair of systems in jump range
+ * of one another, at typical markets; 0 if none.
+ */
+
+typedef struct {
+    uint16 profit[galsize][galsize];
+    uint8 good[galsize][galsize];
+} arbtype;
+
+/*
+ * Goat soup descriptions of a galaxy packed end to end
+ * in one allocation: system i's is text[offset[i]] to
+ * text[offset[i+1]-1], with no terminator.
+ */
+
+typedef struct {
+    uint16 offset[galsize + 1];
+    const char *text; /* Follows the structure */
+} desctable;
+
+/*
+ * Tables derived from a universe on demand.  The
+ * universe stays read-only; the cache is shared by
+ * all its commanders and filled under its lock.
+ */
+
+typedef struct {
+    locktype lock;
+    routetype *routes[numgalaxies][2]; /* By galaxy and route kind */
+    arbtype *arbs[numgalaxies];
+    desctable *descs[numgalaxies];
+} cachetype;
+
+/*
+ * Goat soup templates compiled to bytecode.  Each op is
+ * one byte: 0 returns, 1-0x7F copies that many bytes of
+ * text that follow, 0x81-0xA4 picks one of five options
+ * of that template at random and runs it, 0xB0-0xB2 are
+ * the names as in desc_list.
+ */
+
+#define soupchoices (0xA4 - 0x81 + 1)
+#define soupsize    (2048)
+#define soupdepth   (16) /* desc_list nests 9 deep */
+
+typedef struct {
+    uint16 option[soupchoices][5]; /* Start of each option in code */
+    uint16 root;                   /* Start of a whole description */
+    uint8 code[soupsize];
+} souptype;
+
+typedef struct txtelite_universe {
+    const galaxytype *galaxies; /* numgalaxies of them */
+#ifndef TXTELITE_PREBUILT
+    galaxytype built[numgalaxies]; /* Generated at startup */
+#endif /* ifndef TXTELITE_PREBUILT */
+    gridtype grids[numgalaxies];
+    graphtype graphs[numgalaxies];
+    myuint graphrange; /* Jump range the graphs were built for */
+    marketcube markets;
+    souptype soup;
+    cachetype *cache;
+} universetype; /* Shared and read-only once built */
+
+/*
+ * Weak random number generator, as supplied by D. McDonnell
+ * from SAS Institute C.  Each draw maps the state s to
+ * 3677*s + 3679 and returns that plus one, all modulo 2^31.
+ * Any number of generators can be run independently.
+ */
+
+typedef struct {
+    unsigned int lastrand;
+} rngtype;
+
+/*
+ * Per-commander context; everything a game session
+ * mutates lives here so that any number of sessions
+ * can share one universe without locking
+ */
+
+typedef struct txtelite {
+    const universetype *universe; /* Shared universe */
+    const galaxytype *galaxy;     /* Current galaxy within universe */
+    const gridtype *grid;         /* and its spatial index */
+    const graphtype *graph;       /* and jump graph */
+
+    /* Player workspace */
+    myuint shipshold[lasttrade + 1]; /* Contents of cargo bay */
+    planetnum currentplanet;         /* Current planet */
+    myuint galaxynum;                /* Galaxy number (1-8) */
+    int32 cash;
+    myuint fuel;
+    markettype localmarket;
+    myuint holdspace;
+
+    /* Random number state */
+    boolean nativerand;
+    rngtype rng;               /* Weak generator */
+    unsigned long draws;       /* Random numbers drawn, from either */
+    unsigned int nativeseed;   /* libc's generator was last seeded with */
+    unsigned long nativedraws; /* and has been drawn from since */
+
+    boolean quit;
+} contexttype;
+
+/*
+ * A commander's state in fixed layout, TXTELITE_SNAPSHOT
+ * bytes in host byte order with no padding, so it is saved
+ * and restored with one copy each way and an array of them
+ * can be mapped from a file and restored in place.  The
+ * magic number is only read back in the same byte order.
+ */
+
+#define snapmagic  (0x54455332U) /* "TES2" */
+#define snapnative (1)           /* Flag bits */
+#define snapquit   (2)
+
+typedef struct {
+    unsigned int magic;
+    unsigned int lastrand; /* Weak generator */
+    unsigned int cashlo; /* Cash as 64 bit two's complement */
+    unsigned int cashhi;
+    uint16 galaxynum;
+    uint16 currentplanet;
+    uint16 fuel;
+    uint16 holdspace;
+    uint16 flags;
+    uint16 shipshold[lasttrade + 1];
+    markettype localmarket;
+} snapshottype;
+
+typedef char snapsizecheck[(sizeof(snapshottype) == TXTELITE_SNAPSHOT) ? 1 : -1];
+
+typedef struct {
+    char *buf;
+    size_t size; /* Including terminator */
+    size_t len;  /* Full length, even if truncated */
+} desctype;      /* Goat soup output */
+
+#define desclen (256) /* Longest description is well under this */
+
+static void descput(desctype *desc, int c);
+static void descputs(desctype *desc, const char *s);
+static boolean compilesoup(souptype *soup);
+static void expandsoup(const souptype *soup, fastseedtype *rnd_seed, const char *name, desctype *desc);
 
 static int fuelcost = 2;  /* 0.2 CR/Light year */
 static int maxfuel  = 70; /* 7.0 LY tank */
@@ -163,25 +407,29 @@ static const uint16 base0 = 0x5A4A;
 static const uint16 base1 = 0x0248;
 static const uint16 base2 = 0xB753; /* Base seed for galaxy 1 */
 
-static char pairs[] = "ABOUSEITILETSTONLONUTHNO"
-                      "..LEXEGEZACEBISO"
-                      "USESARMAINDIREA."
-                      "ERATENBERALAVETI"
-                      "EDORQUANTEISRION"; /* Dots should be nullprint characters */
+#ifdef TXTELITE_PREBUILT
+# include "universe.h" /* Made by mkuniverse; see Makefile */
+#endif /* ifdef TXTELITE_PREBUILT */
+
+static const char pairs[] = "ABOUSEITILETSTONLONUTHNO"
+                            "..LEXEGEZACEBISO"
+                            "USESARMAINDIREA."
+                            "ERATENBERALAVETI"
+                            "EDORQUANTEISRION"; /* Dots should be nullprint characters */
 
-static char govnames[8][maxlen] = {"Anarchy",   "Feudal",      "Multi-gov", "Dictatorship",
-                                   "Communist", "Confederacy", "Democracy", "Corporate State"};
+static const char govnames[8][maxlen] = {"Anarchy",   "Feudal",      "Multi-gov", "Dictatorship",
+                                         "Communist", "Confederacy", "Democracy", "Corporate State"};
 
-static char econnames[8][maxlen] = {"Rich Ind",    "Average Ind", "Poor Ind",     "Mainly Ind",
-                                    "Mainly Agri", "Rich Agri",   "Average Agri", "Poor Agri"};
+static const char econnames[8][maxlen] = {"Rich Ind",    "Average Ind", "Poor Ind",     "Mainly Ind",
+                                          "Mainly Agri", "Rich Agri",   "Average Agri", "Poor Agri"};
 
-static char species_stature[3][maxlen]         = {"Large", "Fierce", "Small"};
-static char species_coloration[6][maxlen]      = {"Green", "Red", "Yellow", "Blue", "Black", "Harmless"};
-static char species_characteristics[6][maxlen] = {"Slimy", "Bug-Eyed", "Horned", "Bony", "Fat", "Furry"};
-static char species_base_type[8][maxlen]       = {"Rodents", "Frogs",     "Lizards", "Lobsters",
-                                                  "Birds",   "Humanoids", "Felines", "Insects"};
+static const char species_stature[3][maxlen]         = {"Large", "Fierce", "Small"};
+static const char species_coloration[6][maxlen]      = {"Green", "Red", "Yellow", "Blue", "Black", "Harmless"};
+static const char species_characteristics[6][maxlen] = {"Slimy", "Bug-Eyed", "Horned", "Bony", "Fat", "Furry"};
+static const char species_base_type[8][maxlen]       = {"Rodents", "Frogs",     "Lizards", "Lobsters",
+                                                        "Birds",   "Humanoids", "Felines", "Insects"};
 
-static char unitnames[3][5] = {"t", "kg", "g"};
+static const char unitnames[3][5] = {"t", "kg", "g"};
 
 /* Data for DB's price/availability generation system */
 
@@ -193,7 +441,7 @@ static char unitnames[3][5] = {"t", "kg", "g"};
 /* Set to 1 for NES-sanitised trade goods */
 #define POLITICALLY_CORRECT 0
 
-static tradegood commodities[] = {
+static const tradegood commodities[] = {
     {0x13, -0x02, 0x06, 0x01, 0, "Food        "},
     {0x14, -0x01, 0x0A, 0x03, 0, "Textiles    "},
     {0x41, -0x03, 0x02, 0x07, 0, "Radioactives"},
@@ -222,66 +470,132 @@ static tradegood commodities[] = {
     {0x35, +0x0F, 0xC0, 0x07, 0, "Alien Items "},
 };
 
-/** Required data for text interface **/
+/** Random numbers **/
+
+#define rngmul  (3677U)
+#define rngadd  (3679U)
+#define rngmask (0x7fffffffU)
+#define rngperiod (rngmask + 1UL) /* Every state comes round, as rngadd is odd and 4 divides rngmul-1 */
 
 /*
- * Tradegood names used in text commands
- * Set using commodities array
+ * Only the low 31 bits of state and arithmetic matter, so
+ * unsigned int wrapping at 2^32 (or more) does no harm
  */
 
-static char tradnames[lasttrade][maxlen];
+static void
+rngseed(rngtype *rng, unsigned int seed) {
+    rng->lastrand = seed - 1;
+}
 
-#define nocomms (14)
-
-static boolean dobuy       (char *);
-static boolean dosell      (char *);
-static boolean dofuel      (char *);
-static boolean dojump      (char *);
-static boolean docash      (char *);
-static boolean domkt       (char *);
-static boolean dohelp      (char *);
-static boolean dohold      (char *);
-static boolean dosneak     (char *);
-static boolean dolocal     (char *);
-static boolean doinfo      (char *);
-static boolean dogalhyp    (char *);
-static boolean doquit      (char *);
-static boolean dotweakrand (char *);
-
-static char commands[nocomms][maxlen] = {"buy",  "sell",  "fuel",  "jump", "cash",   "mkt",  "help",
-                                         "hold", "sneak", "local", "info", "galhyp", "quit", "rand"};
-
-static boolean (*comfuncs[nocomms])(char *) = {dobuy,  dosell,  dofuel,  dojump, docash,   domkt,  dohelp,
-                                               dohold, dosneak, dolocal, doinfo, dogalhyp, doquit, dotweakrand};
+static int
+rngnext(rngtype *rng) {
+    unsigned int lastrand = rng->lastrand;
+    int r;
 
-/** General functions **/
+    r = (int)((((((((((((lastrand << 3) - lastrand) << 3) + lastrand) << 1) + lastrand) << 4) - lastrand) << 1) - lastrand)
+               + 0xe60)
+              & rngmask);
+    rng->lastrand = (unsigned int)r - 1;
 
-static unsigned int lastrand = 0;
+    return r;
+}
 
 static void
-mysrand(unsigned int lseed) {
-    srand(lseed);
-    lastrand = lseed - 1;
+rngpower(unsigned long n, unsigned int *mul, unsigned int *add)
+/*
+ * Affine map of n draws, s -> mul*s + add,
+ * composed by repeated squaring
+ */
+{
+    unsigned int m = 1, a = 0, sm = rngmul, sa = rngadd;
+
+    while (n > 0) {
+        if (n & 1) {
+            m = m * sm;
+            a = a * sm + sa;
+        }
+
+        sa = sa * sm + sa;
+        sm = sm * sm;
+        n >>= 1;
+    }
+
+    *mul = m & rngmask;
+    *add = a & rngmask;
 }
 
-static int
-myrand(void) {
-    int r;
+static void
+rngskip(rngtype *rng, unsigned long n) /* As n draws, in O(log n) */
+{
+    unsigned int mul, add;
+
+    rngpower(n, &mul, &add);
+    rng->lastrand = (mul * rng->lastrand + add) & rngmask;
+}
 
-    if (nativerand) {
-        r = rand();
-    } else { /* As supplied by D. McDonnell from SAS Institute C */
-        r = (((((((((((lastrand << 3) - lastrand) << 3) + lastrand) << 1) + lastrand) << 4) - lastrand) << 1) - lastrand) + 0xe60)
-             & 0x7fffffff;
-        lastrand = (unsigned int)r - 1;
+#define rnglanes (8)
+
+static void
+rngbytes(rngtype *rng, uint8 *out, size_t n)
+/*
+ * Low bytes of the next n draws, as n randbyte()s.
+ * Lane j holds every rnglanes'th state, starting with
+ * the j+1'th, so the lanes step independently and the
+ * inner loops vectorise.
+ */
+{
+    unsigned int lane[rnglanes], mul, add;
+    size_t i = 0;
+    int j;
+
+    if (n >= rnglanes) {
+        lane[0] = (rngmul * rng->lastrand + rngadd) & rngmask;
+        for (j = 1; j < rnglanes; j++) lane[j] = (rngmul * lane[j - 1] + rngadd) & rngmask;
+
+        rngpower(rnglanes, &mul, &add);
+        for (; i + rnglanes <= n; i += rnglanes) {
+            for (j = 0; j < rnglanes; j++) out[i + j] = (uint8)(lane[j] + 1);
+
+            rng->lastrand = lane[rnglanes - 1];
+            for (j = 0; j < rnglanes; j++) lane[j] = (mul * lane[j] + add) & rngmask;
+        }
     }
 
-    return r;
+    for (; i < n; i++) out[i] = (uint8)rngnext(rng);
+}
+
+/** General functions **/
+
+static void
+mysrand(contexttype *ctx, unsigned int lseed)
+/*
+ * Native randomization is libc's single global
+ * stream, so only seed it when it is in use
+ */
+{
+    if (ctx->nativerand) {
+        srand(lseed);
+        ctx->nativeseed  = lseed;
+        ctx->nativedraws = 0;
+    }
+
+    rngseed(&ctx->rng, lseed);
+}
+
+static int
+myrand(contexttype *ctx) {
+    ctx->draws++;
+    if (!ctx->nativerand)
+        return rngnext(&ctx->rng);
+
+    ctx->nativedraws++;
+
+    return rand();
 }
 
 static char
-randbyte(void) {
-    return (char)(myrand() & 0xFF);
+randbyte(contexttype *ctx) {
+    return (char)(myrand(ctx) & 0xFF);
 }
 
 static myuint
@@ -292,12 +606,6 @@ mymin(myuint a, myuint b) {
         return b;
 }
 
-/** ftoi **/
-static signed int
-ftoi(double value) {
-    return (signed int)(double)floor(value + 0.5);
-}
-
 static void
 tweakseed(seedtype *s) {
     uint16 temp;
@@ -308,96 +616,185 @@ tweakseed(seedtype *s) {
     (*s).w2 = temp;
 }
 
-/** String functions for text interface **/
+/** Parallel execution **/
 
-static void
-stripout(char *s, const char c) /* Remove all c's from string s */
-{
-    size_t i = 0, j = 0;
+/*
+ * Work is split into numbered tasks which idle workers
+ * claim in order, so that uneven tasks balance out.
+ * Results must only depend on the task number, never
+ * on which worker ran it or when.
+ */
 
-    while (i < strlen(s)) {
-        if (s[i] != c) {
-            s[j] = s[i];
-            j++;
-        }
+typedef void (*tasktype)(void *arg, int task);
 
-        i++;
+static int numthreads = 0; /* Workers; 0 until first use */
+
+#ifdef TXTELITE_THREADS
+
+typedef struct {
+    tasktype fn;
+    void *arg;
+    int ntasks;
+    int next; /* Next unclaimed task */
+    pthread_mutex_t lock;
+} taskqueue;
+
+static void *
+taskworker(void *q_) {
+    taskqueue *q = (taskqueue *)q_;
+
+    for (;;) {
+        int task;
+
+        (void)pthread_mutex_lock(&q->lock);
+        task = q->next++;
+        (void)pthread_mutex_unlock(&q->lock);
+
+        if (task >= q->ntasks)
+            break;
+
+        q->fn(q->arg, task);
     }
-    s[j] = 0;
+
+    return NULL;
 }
 
 static int
-stringbeg(const char *s, const char *t)
-/*
- * Return nonzero (true) if string t
- * begins with non-empty string s
- */
-{
-    size_t len_s = strlen(s);
-    size_t len_t = strlen(t);
+getthreads(void) {
+    if (numthreads <= 0) {
+        numthreads = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+        {
+            long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+            if (n > 1)
+                numthreads = n > 64 ? 64 : (int)n;
+        }
+#endif /* ifdef _SC_NPROCESSORS_ONLN */
+    }
 
-    if (len_t < len_s)
-        return false;
+    return numthreads;
+}
 
-    return strncasecmp(s, t, len_s) == 0;
+#endif /* ifdef TXTELITE_THREADS */
+
+static void
+initlock(locktype *l) {
+#ifdef TXTELITE_THREADS
+    (void)pthread_mutex_init(l, NULL);
+#else
+    *l = 0;
+#endif /* ifdef TXTELITE_THREADS */
 }
 
-static myuint
-stringmatch(char *s, char a[][20], myuint n)
+static void
+freelock(locktype *l) {
+#ifdef TXTELITE_THREADS
+    (void)pthread_mutex_destroy(l);
+#else
+    (void)l;
+#endif /* ifdef TXTELITE_THREADS */
+}
+
+static void
+lock(locktype *l) {
+#ifdef TXTELITE_THREADS
+    (void)pthread_mutex_lock(l);
+#else
+    (void)l;
+#endif /* ifdef TXTELITE_THREADS */
+}
+
+static void
+unlock(locktype *l) {
+#ifdef TXTELITE_THREADS
+    (void)pthread_mutex_unlock(l);
+#else
+    (void)l;
+#endif /* ifdef TXTELITE_THREADS */
+}
+
+static void
+runparallel(tasktype fn, void *arg, int ntasks)
 /*
- * Check string s against n options in string array a
- * If matches ith element return i+1 else return 0
+ * Call fn(arg, task) for every task in 0..ntasks-1
+ * Returns when all are done
  */
 {
-    myuint i = 0;
+#ifdef TXTELITE_THREADS
+    pthread_t workers[64];
+    taskqueue q;
+    int n = getthreads(), i, started = 0;
 
-    while (i < n) {
-        if (stringbeg(s, a[i]))
-            return i + 1;
+    if (n > ntasks)
+        n = ntasks;
 
-        i++;
+    if (n > 1) {
+        q.fn     = fn;
+        q.arg    = arg;
+        q.ntasks = ntasks;
+        q.next   = 0;
+        (void)pthread_mutex_init(&q.lock, NULL);
+
+        for (i = 1; i < n; i++)
+            if (pthread_create(&workers[started], NULL, taskworker, &q) == 0)
+                started++;
+
+        (void)taskworker(&q); /* This thread works too */
+
+        for (i = 0; i < started; i++) (void)pthread_join(workers[i], NULL);
+
+        (void)pthread_mutex_destroy(&q.lock);
+
+        return;
     }
+#endif /* ifdef TXTELITE_THREADS */
 
-    return 0;
+    {
+        int task;
+
+        for (task = 0; task < ntasks; task++) fn(arg, task);
+    }
 }
 
+/** String functions **/
+
 static void
-spacesplit(char *s, char *t)
-/*
- * Split string s at first space, returning
- * first 'word' in t & shortening s
- */
+stripout(char *s, const char c) /* Remove all c's from string s */
 {
     size_t i = 0, j = 0;
-    size_t l = strlen(s);
 
-    while ((i < l) & (s[i] == ' '))
-        i++;
-
-    /* Strip leading spaces */
-    if (i == l) {
-        s[0] = 0;
-        t[0] = 0;
+    while (s[i] != '\0') {
+        if (s[i] != c) {
+            s[j] = s[i];
+            j++;
+        }
 
-        return;
+        i++;
     }
 
-    while ((i < l) & (s[i] != ' '))
-        t[j++] = s[i++];
-    t[j] = 0;
+    while (j < i) s[j++] = 0; /* No stale characters past the end */
+}
+
+static int
+stringbeg(const char *s, size_t len_s, const char *t)
+/*
+ * Return nonzero (true) if string t begins
+ * with the len_s characters at s, ignoring case
+ */
+{
+    size_t len_t = strlen(t);
 
-    i++;
-    j = 0;
+    if (len_t < len_s)
+        return false;
 
-    while (i < l)
-        s[j++] = s[i++];
-    s[j] = 0;
+    return strncasecmp(s, t, len_s) == 0;
 }
 
 /** Functions for stock market **/
 
 static myuint
-gamebuy(myuint i, myuint a)
+gamebuy(contexttype *ctx, myuint i, myuint a)
 /*
  * Try to buy amount a of good i
  * Return amount bought
@@ -407,42 +804,62 @@ gamebuy(myuint i, myuint a)
 {
     myuint t;
 
-    if (cash < 0) {
+    if (ctx->cash < 0) {
         t = 0;
     } else {
-        t = mymin(localmarket.quantity[i], a);
+        t = mymin(ctx->localmarket.quantity[i], a);
         if ((commodities[i].units) == tonnes)
-            t = mymin(holdspace, t);
+            t = mymin(ctx->holdspace, t);
 
-        t = mymin(t, (myuint)(double)floor((double)cash / (localmarket.price[i])));
+        t = mymin(t, (myuint)(double)floor((double)ctx->cash / (ctx->localmarket.price[i])));
     }
 
-    shipshold[i] += t;
-    localmarket.quantity[i] -= t;
-    cash -= t * (localmarket.price[i]);
+    ctx->shipshold[i] += t;
+    ctx->localmarket.quantity[i] -= t;
+    ctx->cash -= t * (ctx->localmarket.price[i]);
     if ((commodities[i].units) == tonnes)
-        holdspace -= t;
+        ctx->holdspace -= t;
 
     return t;
 }
 
 static myuint
-gamesell(myuint i, myuint a) /* As gamebuy but selling */
+gamesell(contexttype *ctx, myuint i, myuint a) /* As gamebuy but selling */
 {
-    myuint t = mymin(shipshold[i], a);
+    myuint t = mymin(ctx->shipshold[i], a);
 
-    shipshold[i] -= t;
-    localmarket.quantity[i] += t;
+    ctx->shipshold[i] -= t;
+    ctx->localmarket.quantity[i] += t;
     if ((commodities[i].units) == tonnes)
-        holdspace += t;
+        ctx->holdspace += t;
 
-    cash += t * (localmarket.price[i]);
+    ctx->cash += t * (ctx->localmarket.price[i]);
 
     return t;
 }
 
-static markettype
-genmarket(myuint fluct, plansys p)
+static myuint
+gamefuel(contexttype *ctx, myuint f)
+/*
+ * Attempt to buy f tonnes of fuel
+ */
+{
+    if (f + ctx->fuel > maxfuel)
+        f = (myuint)maxfuel - ctx->fuel;
+
+    if (fuelcost > 0) {
+        if ((int)f * fuelcost > ctx->cash)
+            f = (myuint)(ctx->cash / fuelcost);
+    }
+
+    ctx->fuel += f;
+    ctx->cash -= fuelcost * f;
+
+    return f;
+}
+
+static void
+genmarkets(marketcube *cube)
 /*
  * Prices and availabilities are influenced by the planet's economy type
  * (0-7) and a random "fluctuation" byte that was kept within the saved
@@ -460,44 +877,75 @@ genmarket(myuint fluct, plansys p)
  * The player's cash is held in four bytes.
  */
 {
-    markettype market;
-    unsigned short i;
+    int economy, i, fluct;
 
-    for (i = 0; i <= lasttrade; i++) {
-        signed int q;
-        signed int product  = (p.economy) * (commodities[i].gradient);
-        signed int changing = fluct & (commodities[i].maskbyte);
-        q                   = (commodities[i].basequant) + changing - product;
-        q                   = q & 0xFF;
-        if (q & 0x80)
-            q = 0;
+    for (economy = 0; economy < numeconomies; economy++) {
+        for (i = 0; i <= lasttrade; i++) {
+            const signed int product   = economy * (commodities[i].gradient);
+            const signed int basequant = commodities[i].basequant;
+            const signed int baseprice = commodities[i].baseprice;
+            const signed int maskbyte  = commodities[i].maskbyte;
+            uint16 *price              = cube->price[economy][i];
+            uint8 *quantity            = cube->quantity[economy][i];
+
+            for (fluct = 0; fluct < 256; fluct++) {
+                signed int changing = fluct & maskbyte;
+                signed int q        = (basequant + changing - product) & 0xFF;
 
-        /* Clip to positive 8-bit */
-        market.quantity[i] = (uint16)(q & 0x3F); /* Mask to 6 bits */
+                /* Clip to positive 8-bit, mask to 6 bits */
+                quantity[fluct] = (uint8)((q & 0x80) ? 0 : q & 0x3F);
 
-        q               = (commodities[i].baseprice) + changing + product;
-        q               = q & 0xFF;
-        market.price[i] = (uint16)(q * 4);
+                price[fluct] = (uint16)(((baseprice + changing + product) & 0xFF) * 4);
+            }
+        }
+
+        /* Override to force nonavailability */
+        (void)memset(cube->quantity[economy][AlienItems], 0, sizeof(cube->quantity[economy][AlienItems]));
+
+        for (i = 0; i <= lasttrade; i++) {
+            unsigned long price = 0, quantity = 0;
+
+            for (fluct = 0; fluct < 256; fluct++) {
+                price += cube->price[economy][i][fluct];
+                quantity += cube->quantity[economy][i][fluct];
+            }
+
+            cube->typical[economy].price[i]    = (myuint)((price + 128) / 256);
+            cube->typical[economy].quantity[i] = (myuint)(quantity / 256);
+        }
     }
 
-    market.quantity[AlienItems] = 0; /* Override to force nonavailability */
+    for (economy = 0; economy < numeconomies; economy++) {
+        const markettype *here = &cube->typical[economy];
+        int there;
 
-    return market;
+        for (there = 0; there < numeconomies; there++) {
+            int best = 0, good = 0;
+
+            for (i = 0; i <= lasttrade; i++) {
+                int profit = cube->typical[there].price[i] - here->price[i];
+
+                if ((commodities[i].units == tonnes) && (here->quantity[i] > 0) && (profit > best)) {
+                    best = profit;
+                    good = i;
+                }
+            }
+
+            cube->arbprofit[economy][there] = (uint16)best;
+            cube->arbgood[economy][there]   = (uint8)good;
+        }
+    }
 }
 
 static void
-displaymarket(markettype m) {
-    unsigned short i;
+getmarket(markettype *m, const marketcube *cube, myuint fluct, myuint economy) /* Look one market up */
+{
+    myuint i;
 
-    (void)printf("Item         \t  Price\t   Quantity  \tHold\n");
-    (void)printf("=============\t ======\t  ========== \t====\n");
+    fluct &= 0xFF; /* randbyte() may sign extend */
     for (i = 0; i <= lasttrade; i++) {
-        (void)printf("\n");
-        (void)printf("%s", commodities[i].name);
-        (void)printf("\t %6.1f", (double)((float)(m.price[i]) / 10));
-        (void)printf("\t %6u", m.quantity[i]);
-        (void)printf("%s", unitnames[commodities[i].units]);
-        (void)printf("\t %2u", shipshold[i]);
+        m->quantity[i] = cube->quantity[economy][i][fluct];
+        m->price[i]    = cube->price[economy][i][fluct];
     }
 }
 
@@ -508,7 +956,9 @@ makesystem(seedtype *s) {
     plansys thissys;
     myuint pair1, pair2, pair3, pair4;
     uint16 longnameflag = ((*s).w0) & 64;
-    char *pairs1        = &pairs[24]; /* Start of pairs used by this routine */
+    const char *pairs1  = &pairs[24]; /* Start of pairs used by this routine */
+
+    (void)memset(&thissys, 0, sizeof(thissys)); /* Reproducible padding */
 
     thissys.x = (((*s).w1) >> 8);
     thissys.y = (((*s).w0) >> 8);
@@ -610,55 +1060,306 @@ nextgalaxy(seedtype *s)
     (*s).w2 = twist((*s).w2);
 }
 
-/* Original game generated from scratch each time info needed */
-
-static void
-buildgalaxy(myuint lgalaxynum) {
-    myuint syscount, galcount;
-
-    seed.w0 = base0;
-    seed.w1 = base1;
-    seed.w2 = base2; /* Initialise seed for galaxy 1 */
-    for (galcount = 1; galcount < lgalaxynum; ++galcount) nextgalaxy(&seed);
+/* Seed jump-ahead */
 
-    /* Put galaxy data into array of structures */
-    for (syscount = 0; syscount < galsize; ++syscount) galaxy[syscount] = makesystem(&seed);
-}
+/*
+ * tweakseed is linear over 16 bit words:
+ *
+ *   (w0 w1 w2) <- (w0 w1 w2) * | 0 0 1 |
+ *                              | 1 0 1 |
+ *                              | 0 1 1 |
+ *
+ * so n tweaks are one product with the nth power of
+ * that matrix, found by squaring in O(log n) steps.
+ * Each system takes four tweaks.
+ */
 
-/** Functions for navigation **/
+typedef struct {
+    uint16 m[3][3];
+} seedmatrix;
 
 static void
-gamejump(planetnum i) /* Move to system i */
+seedmatmul(seedmatrix *r, const seedmatrix *a, const seedmatrix *b) /* r = a * b mod 2^16 */
 {
-    currentplanet = i;
-    localmarket   = genmarket((myuint)randbyte(), galaxy[i]);
-}
+    seedmatrix t;
+    int i, j, k;
 
-static myuint
-distance(plansys a, plansys b)
+    for (i = 0; i < 3; i++)
+        for (j = 0; j < 3; j++) {
+            unsigned long sum = 0;
+
+            for (k = 0; k < 3; k++) sum += (unsigned long)a->m[i][k] * b->m[k][j];
+
+            t.m[i][j] = (uint16)(sum & 0xFFFF);
+        }
+
+    *r = t;
+}
+
+static void
+skipseed(seedtype *s, unsigned long n) /* Same as n calls of tweakseed */
+{
+    seedmatrix p = {{{0, 0, 1}, {1, 0, 1}, {0, 1, 1}}};
+    seedmatrix r = {{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+    unsigned long w0 = s->w0, w1 = s->w1, w2 = s->w2;
+
+    while (n) {
+        if (n & 1)
+            seedmatmul(&r, &r, &p);
+
+        seedmatmul(&p, &p, &p);
+        n >>= 1;
+    }
+
+    s->w0 = (uint16)((w0 * r.m[0][0] + w1 * r.m[1][0] + w2 * r.m[2][0]) & 0xFFFF);
+    s->w1 = (uint16)((w0 * r.m[0][1] + w1 * r.m[1][1] + w2 * r.m[2][1]) & 0xFFFF);
+    s->w2 = (uint16)((w0 * r.m[0][2] + w1 * r.m[1][2] + w2 * r.m[2][2]) & 0xFFFF);
+}
+
+static void
+systemseed(seedtype *s, myuint lgalaxynum, planetnum n)
+/*
+ * Seed that generates system n of galaxy lgalaxynum,
+ * without generating any system before it
+ */
+{
+    myuint galcount;
+
+    s->w0 = base0;
+    s->w1 = base1;
+    s->w2 = base2; /* Initialise seed for galaxy 1 */
+    for (galcount = 1; galcount < lgalaxynum; ++galcount) nextgalaxy(s);
+
+    skipseed(s, 4 * (unsigned long)n);
+}
+
+static plansys
+getsystem(myuint lgalaxynum, planetnum n) /* Generate one system on demand */
+{
+    seedtype seed;
+
+    systemseed(&seed, lgalaxynum, n);
+
+    return makesystem(&seed);
+}
+
+/* Galaxy accessors */
+
+static plansys
+unpacksystem(const galaxytype *g, planetnum i) {
+    plansys p;
+
+    (void)memset(&p, 0, sizeof(p));
+    p.x            = g->x[i];
+    p.y            = g->y[i];
+    p.economy      = g->economy[i];
+    p.govtype      = g->govtype[i];
+    p.techlev      = g->techlev[i];
+    p.population   = g->population[i];
+    p.productivity = g->productivity[i];
+    p.radius       = g->radius[i];
+    p.human_colony = g->human_colony[i];
+    p.species_type = g->species_type[i];
+    p.species_adj1 = g->species_adj1[i];
+    p.species_adj2 = g->species_adj2[i];
+    p.species_adj3 = g->species_adj3[i];
+    p.goatsoupseed = g->goatsoupseed[i];
+    (void)memcpy(p.name, g->name[i], namelen);
+
+    return p;
+}
+
+/* Original game generated from scratch each time info needed */
+
+#ifndef TXTELITE_PREBUILT
+
+static void
+packsystem(galaxytype *g, planetnum i, const plansys *p) {
+    g->x[i]            = (uint8)p->x;
+    g->y[i]            = (uint8)p->y;
+    g->economy[i]      = (uint8)p->economy;
+    g->govtype[i]      = (uint8)p->govtype;
+    g->techlev[i]      = (uint8)p->techlev;
+    g->population[i]   = (uint8)p->population;
+    g->productivity[i] = p->productivity;
+    g->radius[i]       = p->radius;
+    g->human_colony[i] = (uint8)p->human_colony;
+    g->species_type[i] = (uint8)p->species_type;
+    g->species_adj1[i] = (uint8)p->species_adj1;
+    g->species_adj2[i] = (uint8)p->species_adj2;
+    g->species_adj3[i] = (uint8)p->species_adj3;
+    g->goatsoupseed[i] = p->goatsoupseed;
+    (void)memcpy(g->name[i], p->name, namelen);
+}
+
+static void
+buildsystems(galaxytype *galaxy, myuint lgalaxynum, planetnum first, planetnum count)
+/*
+ * Generate count systems from first onwards
+ */
+{
+    planetnum syscount;
+    seedtype seed;
+
+    systemseed(&seed, lgalaxynum, first);
+
+    /* Put galaxy data into structure of arrays */
+    for (syscount = first; syscount < first + count; ++syscount) {
+        plansys p = makesystem(&seed);
+
+        packsystem(galaxy, syscount, &p);
+    }
+}
+
+#define buildchunk (64) /* Systems per parallel task */
+
+static void
+buildtask(void *galaxies_, int task) {
+    galaxytype *galaxies = (galaxytype *)galaxies_;
+    int galcount         = task / (galsize / buildchunk);
+    int first            = (task % (galsize / buildchunk)) * buildchunk;
+
+    buildsystems(&galaxies[galcount], (myuint)(galcount + 1), first, buildchunk);
+}
+
+static void
+buildgalaxies(galaxytype *galaxies)
+/*
+ * All eight galaxies in parallel chunks
+ */
+{
+    runparallel(buildtask, galaxies, numgalaxies * (galsize / buildchunk));
+}
+
+#endif /* ifndef TXTELITE_PREBUILT */
+
+/** Functions for navigation **/
+
+static void
+gamejump(contexttype *ctx, planetnum i) /* Move to system i */
+{
+    ctx->currentplanet = i;
+    getmarket(&ctx->localmarket, &ctx->universe->markets, (myuint)randbyte(ctx), ctx->galaxy->economy[i]);
+}
+
+static void
+gamegalaxy(contexttype *ctx, myuint lgalaxynum) /* Switch to galaxy (1-8) */
+{
+    ctx->galaxynum = lgalaxynum;
+    ctx->galaxy    = &ctx->universe->galaxies[lgalaxynum - 1];
+    ctx->grid      = &ctx->universe->grids[lgalaxynum - 1];
+    ctx->graph     = &ctx->universe->graphs[lgalaxynum - 1];
+}
+
+static void
+gamegalhyp(contexttype *ctx)
+/*
+ * Jump to next galaxy
+ * Preserve planetnum (eg. if leave 7th
+ * planet arrive at 7th planet)
+ */
+{
+    if (ctx->galaxynum == numgalaxies)
+        gamegalaxy(ctx, 1);
+    else
+        gamegalaxy(ctx, ctx->galaxynum + 1);
+}
+
+/*
+ * Separation is floor(4*sqrt(X*X+Y*Y/4)+0.5), with Y*Y/4
+ * an integer division.  That is sqrt(m) rounded to the
+ * nearest integer for m = 16*(X*X+Y*Y/4) < 2^21.  With
+ * r = isqrt(m), sqrt(m) >= r+0.5 exactly when m > r*r+r,
+ * so no floating point is needed; the result is the same
+ * for every X and Y up to 255 ("make check" tries them all).
+ * The root is built one bit at a time with no branches,
+ * so the batch version below vectorises.
+ */
+
+#define ROOTBIT(B)         \
+    t = r | (B);           \
+    r = (t * t <= m) ? t : r;
+
+static myuint
+distroot(unsigned int m) /* Rounded square root for m < 2^22 */
+{
+    unsigned int r = 0, t;
+
+    ROOTBIT(1024) ROOTBIT(512) ROOTBIT(256) ROOTBIT(128) ROOTBIT(64) ROOTBIT(32)
+    ROOTBIT(16) ROOTBIT(8) ROOTBIT(4) ROOTBIT(2) ROOTBIT(1)
+
+    return (myuint)(r + (m > r * r + r));
+}
+
+static myuint
+separation(int dx, int dy) /* 4*sqrt(dx*dx+dy*dy/4), for dx and dy within the map */
+{
+    unsigned int ax = (dx < 0) ? 0U - (unsigned int)dx : (unsigned int)dx;
+    unsigned int ay = (dy < 0) ? 0U - (unsigned int)dy : (unsigned int)dy;
+
+    return distroot(16 * (ax * ax + ((ay * ay) >> 2)));
+}
+
+static int
+clampmap(long v) /* Nearest map coordinate, 0-255 */
+{
+    return (v < 0) ? 0 : (v > 255) ? 255 : (int)v;
+}
+
+static myuint
+distance(const galaxytype *g, planetnum a, planetnum b)
 /*
  * Separation between two planets
  * (4*sqrt(X*X+Y*Y/4))
  */
 {
-    return (myuint)ftoi(4 * sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y) / 4));
+    return separation(g->x[a] - g->x[b], g->y[a] - g->y[b]);
+}
+
+static void
+distances(const galaxytype *g, planetnum a, myuint *d)
+/*
+ * Separation from a to every planet in the galaxy
+ * into d[0..galsize-1]; as distance() but in bulk
+ */
+{
+    int ax = g->x[a], ay = g->y[a];
+    planetnum i;
+
+    for (i = 0; i < galsize; i++) {
+        int dx         = g->x[i] - ax;
+        int dy         = g->y[i] - ay;
+        unsigned int m = 16 * ((unsigned int)(dx * dx) + ((unsigned int)(dy * dy) >> 2));
+        unsigned int r = 0, t;
+
+        ROOTBIT(1024) ROOTBIT(512) ROOTBIT(256) ROOTBIT(128) ROOTBIT(64) ROOTBIT(32)
+        ROOTBIT(16) ROOTBIT(8) ROOTBIT(4) ROOTBIT(2) ROOTBIT(1)
+
+        d[i] = (myuint)(r + (m > r * r + r));
+    }
 }
 
+#undef ROOTBIT
+
 static planetnum
-matchsys(char *s)
+matchsys(const contexttype *ctx, const char *s, size_t len)
 /*
- * Return id of the planet whose name matches passed strinmg
- * closest to currentplanet - if none return currentplanet
+ * Return id of the planet whose name begins with the len
+ * characters at s closest to currentplanet - if none
+ * return currentplanet
  */
 {
+    const galaxytype *galaxy = ctx->galaxy;
     planetnum syscount;
-    planetnum p = currentplanet;
+    planetnum p = ctx->currentplanet;
     myuint d    = 9999;
 
     for (syscount = 0; syscount < galsize; ++syscount) {
-        if (stringbeg(s, galaxy[syscount].name)) {
-            if (distance(galaxy[syscount], galaxy[currentplanet]) < d) {
-                d = distance(galaxy[syscount], galaxy[currentplanet]);
+        if (stringbeg(s, len, galaxy->name[syscount])) {
+            myuint ds = distance(galaxy, syscount, ctx->currentplanet);
+
+            if (ds < d) {
+                d = ds;
                 p = syscount;
             }
         }
@@ -667,446 +1368,4742 @@ matchsys(char *s)
     return p;
 }
 
-/** Print data for given system **/
+static int
+gamehyperjump(contexttype *ctx, planetnum dest)
+/*
+ * Jump to system dest if fuel allows
+ * Return TXTELITE_OK or why not
+ */
+{
+    myuint d;
+
+    if (dest == ctx->currentplanet)
+        return TXTELITE_BADJUMP;
 
-static void
-prisys(plansys plsy, boolean compressed) {
-    if (compressed) {
-        (void)printf("%10s", plsy.name);
-        (void)printf(" TL: %2i ", (plsy.techlev) + 1);
-        (void)printf("%12s", econnames[plsy.economy]);
-        (void)printf(" %15s", govnames[plsy.govtype]);
+    d = distance(ctx->galaxy, dest, ctx->currentplanet);
+    if (d > ctx->fuel)
+        return TXTELITE_TOOFAR;
+
+    ctx->fuel -= d;
+    gamejump(ctx, dest);
+
+    return TXTELITE_OK;
+}
+
+static int
+gamesneak(contexttype *ctx, planetnum dest)
+/*
+ * As gamehyperjump but no fuel cost
+ */
+{
+    myuint fuelkeep = ctx->fuel;
+    int r;
+
+    ctx->fuel = 666;
+    r         = gamehyperjump(ctx, dest);
+    ctx->fuel = fuelkeep;
+
+    return r;
+}
+
+static boolean
+gamehold(contexttype *ctx, myuint a)
+/*
+ * Resize cargo bay to a tonnes
+ * Fails if current cargo will not fit
+ */
+{
+    myuint t = 0, i;
+
+    for (i = 0; i <= lasttrade; ++i)
+        if ((commodities[i].units) == tonnes)
+            t += ctx->shipshold[i];
+
+    if (t > a)
+        return false;
+
+    ctx->holdspace = a - t;
+
+    return true;
+}
+
+static size_t
+describesys(const souptype *soup, const galaxytype *g, planetnum i, char *buf, size_t size)
+/*
+ * Goat soup description of system i into buf
+ * Return its full length, like snprintf
+ */
+{
+    fastseedtype rnd_seed = g->goatsoupseed[i];
+    desctype desc;
+
+    desc.buf  = buf;
+    desc.size = size;
+    desc.len  = 0;
+    expandsoup(soup, &rnd_seed, g->name[i], &desc);
+    if (size > 0)
+        buf[desc.len < size ? desc.len : size - 1] = '\0';
+
+    return desc.len;
+}
+
+static size_t
+describespecies(const galaxytype *g, planetnum i, char *buf, size_t size)
+/*
+ * Inhabitants of system i into buf
+ * Return full length as describesys
+ */
+{
+    desctype desc;
+
+    desc.buf  = buf;
+    desc.size = size;
+    desc.len  = 0;
+    if (g->human_colony[i]) {
+        descputs(&desc, "Human Colonials");
     } else {
-        (void)printf("System  \t: ");
-        (void)printf("%s", plsy.name);
-        (void)printf("\nPosition  \t: (%i,", plsy.x);
-        (void)printf("%i)", plsy.y);
-        (void)printf("\nEconomy   \t: (%i) ", plsy.economy);
-        (void)printf("%s", econnames[plsy.economy]);
-        (void)printf("\nGovernment\t: (%i) ", plsy.govtype);
-        (void)printf("%s", govnames[plsy.govtype]);
-        (void)printf("\nTech Level\t: %-2i", (plsy.techlev) + 1);
-        (void)printf("\nTurnover  \t: %u", (plsy.productivity));
-        (void)printf("\nRadius    \t: %u", plsy.radius);
-        (void)printf("\nPopulation\t: %.1f Billion", (plsy.population) / 10.0);
-        (void)printf("\nSpecies   \t: ");
-        if (plsy.human_colony) {
-            (void)printf("Human Colonials\n");
-        } else {
-            if (plsy.species_adj1 < 3)
-                (void)printf("%s ", species_stature[plsy.species_adj1]);
+        if (g->species_adj1[i] < 3) {
+            descputs(&desc, species_stature[g->species_adj1[i]]);
+            descput(&desc, ' ');
+        }
+
+        if (g->species_adj2[i] < 6) {
+            descputs(&desc, species_coloration[g->species_adj2[i]]);
+            descput(&desc, ' ');
+        }
+
+        if (g->species_adj3[i] < 6) {
+            descputs(&desc, species_characteristics[g->species_adj3[i]]);
+            descput(&desc, ' ');
+        }
+
+        descputs(&desc, species_base_type[g->species_type[i]]);
+    }
+    if (size > 0)
+        buf[desc.len < size ? desc.len : size - 1] = '\0';
+
+    return desc.len;
+}
+
+/** Spatial index **/
+
+static void
+buildgrid(gridtype *grid, const galaxytype *g)
+/*
+ * Counting sort of systems into cells,
+ * keeping index order within each cell
+ */
+{
+    uint16 fill[gridw * gridh];
+    planetnum i;
+    int c;
+
+    (void)memset(grid->start, 0, sizeof(grid->start));
+    for (i = 0; i < galsize; i++) grid->start[(g->y[i] / cellh) * gridw + g->x[i] / cellw + 1]++;
+
+    for (c = 0; c < gridw * gridh; c++) {
+        grid->start[c + 1] += grid->start[c];
+        fill[c]             = grid->start[c];
+    }
+
+    for (i = 0; i < galsize; i++) grid->item[fill[(g->y[i] / cellh) * gridw + g->x[i] / cellw]++] = (uint16)i;
+}
+
+static void
+gridtask(void *u_, int galcount) {
+    universetype *u = (universetype *)u_;
+
+    buildgrid(&u->grids[galcount], &u->galaxies[galcount]);
+}
+
+static void
+sortbyindex(planetnum *p, myuint *d, int n) /* Insertion sort, n is small */
+{
+    int i, j;
+
+    for (i = 1; i < n; i++) {
+        planetnum pi = p[i];
+        myuint di    = d[i];
+
+        for (j = i; (j > 0) && (p[j - 1] > pi); j--) {
+            p[j] = p[j - 1];
+            d[j] = d[j - 1];
+        }
+        p[j] = pi;
+        d[j] = di;
+    }
+}
+
+static int
+gridwithin(const galaxytype *g, const gridtype *grid, int x, int y, myuint range, planetnum *out, myuint *dist)
+/*
+ * Systems within range of (x,y), in index order,
+ * with their distances; returns how many.  Only
+ * cells that overlap the bounding box are read.
+ */
+{
+    int rx = range / 4 + 1, ry = range / 2 + 1; /* Bounding box half sizes */
+    int cx0 = x - rx, cx1 = x + rx, cy0 = y - ry, cy1 = y + ry;
+    int cx, cy, n = 0;
+
+    cx0 = cx0 < 0 ? 0 : cx0 / cellw;
+    cy0 = cy0 < 0 ? 0 : cy0 / cellh;
+    cx1 = cx1 > 255 ? gridw - 1 : cx1 / cellw;
+    cy1 = cy1 > 255 ? gridh - 1 : cy1 / cellh;
+
+    for (cy = cy0; cy <= cy1; cy++)
+        for (cx = cx0; cx <= cx1; cx++) {
+            int c = cy * gridw + cx, k;
+
+            for (k = grid->start[c]; k < grid->start[c + 1]; k++) {
+                planetnum i = grid->item[k];
+                myuint d    = separation(g->x[i] - x, g->y[i] - y);
+
+                if (d <= range) {
+                    out[n]  = i;
+                    dist[n] = d;
+                    n++;
+                }
+            }
+        }
+
+    sortbyindex(out, dist, n);
+
+    return n;
+}
+
+static int
+gridnearest(const galaxytype *g, const gridtype *grid, int x, int y, int k, planetnum *out, myuint *dist)
+/*
+ * The k systems nearest (x,y), nearest first,
+ * ties going to the lower index; returns how
+ * many (k, unless the galaxy is smaller).  Cells
+ * are read in square rings about the cell holding
+ * (x,y) until no further ring can hold anything
+ * nearer than the kth best so far.
+ */
+{
+    int pcx = x / cellw; /* x and y are on the map */
+    int pcy = y / cellh;
+    int ring, n = 0;
+
+    if (k > galsize)
+        k = galsize;
+
+    for (ring = 0; (ring < gridw) || (ring < gridh); ring++) {
+        int cx, cy;
+
+        /*
+         * Anything in this ring is at least ring-1 whole cells
+         * away, and a cell is 4*cellw = 2*cellh distance units
+         * across in either direction
+         */
+        if ((n == k) && (ring > 1) && ((long)(ring - 1) * 4 * cellw - 2 > (long)dist[n - 1]))
+            break;
+
+        for (cy = pcy - ring; cy <= pcy + ring; cy++) {
+            if ((cy < 0) || (cy >= gridh))
+                continue;
+
+            for (cx = pcx - ring; cx <= pcx + ring; cx++) {
+                int c, j;
+
+                if ((cx < 0) || (cx >= gridw))
+                    continue;
+
+                if ((cy != pcy - ring) && (cy != pcy + ring) && (cx != pcx - ring) && (cx != pcx + ring))
+                    continue; /* Inside the ring, done already */
 
-            if (plsy.species_adj2 < 6)
-                (void)printf("%s ", species_coloration[plsy.species_adj2]);
+                c = cy * gridw + cx;
+                for (j = grid->start[c]; j < grid->start[c + 1]; j++) {
+                    planetnum i = grid->item[j];
+                    myuint d    = separation(g->x[i] - x, g->y[i] - y);
+                    int m;
 
-            if (plsy.species_adj3 < 6)
-                (void)printf("%s ", species_characteristics[plsy.species_adj3]);
+                    if ((n == k) && ((d > dist[n - 1]) || ((d == dist[n - 1]) && (i > out[n - 1]))))
+                        continue;
 
-            (void)printf("%s\n", species_base_type[plsy.species_type]);
+                    if (n < k)
+                        n++;
+
+                    /* Insert in order of distance then index */
+                    for (m = n - 1; (m > 0) && ((dist[m - 1] > d) || ((dist[m - 1] == d) && (out[m - 1] > i))); m--) {
+                        out[m]  = out[m - 1];
+                        dist[m] = dist[m - 1];
+                    }
+                    out[m]  = i;
+                    dist[m] = d;
+                }
+            }
         }
+    }
 
-        rnd_seed = plsy.goatsoupseed;
-        (void)printf("\n");
-        goat_soup("\x8F is \x97.", &plsy);
+    return n;
+}
+
+/** Jump graphs **/
+
+static planetnum
+findroot(uint8 *parent, planetnum i) /* With path halving */
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i         = parent[i];
     }
+
+    return i;
 }
 
-/** Various command functions **/
+static void
+buildcomponents(graphtype *graph)
+/*
+ * Union-find over the edges, always keeping the lower
+ * root, so that every root is its component's label
+ */
+{
+    planetnum i, a, b;
+    int e;
+
+    for (i = 0; i < galsize; i++) graph->comp[i] = (uint8)i;
+
+    for (i = 0; i < galsize; i++)
+        for (e = graph->start[i]; e < graph->start[i + 1]; e++) {
+            a = findroot(graph->comp, i);
+            b = findroot(graph->comp, graph->adj[e]);
+            if (a < b)
+                graph->comp[b] = (uint8)a;
+            else if (b < a)
+                graph->comp[a] = (uint8)b;
+        }
+
+    (void)memset(graph->compsize, 0, sizeof(graph->compsize));
+    for (i = 0; i < galsize; i++) {
+        graph->comp[i] = (uint8)findroot(graph->comp, i);
+        graph->compsize[graph->comp[i]]++;
+    }
+}
 
 static boolean
-dotweakrand(char *s) {
-    (void)s;
-    nativerand ^= 1;
-    (void)printf("%s", nativerand ? "Now using native randomization." : "Now using weak randomization.");
+buildgraph(graphtype *graph, const galaxytype *g, const gridtype *grid, myuint range)
+/*
+ * Count edges with the grid, then fill them
+ * in a second pass; false if out of memory
+ */
+{
+    planetnum found[galsize];
+    myuint dist[galsize];
+    planetnum i;
+    size_t edges;
+    int n, k;
+
+    graph->start[0] = 0;
+    for (i = 0; i < galsize; i++) {
+        n                   = gridwithin(g, grid, g->x[i], g->y[i], range, found, dist);
+        graph->start[i + 1] = (uint16)(graph->start[i] + n - 1); /* Not counting i itself */
+    }
+
+    edges       = graph->start[galsize];
+    graph->dist = (uint16 *)malloc(edges * (sizeof(uint16) + sizeof(uint8)) + 1);
+    if (graph->dist == NULL)
+        return false;
+
+    graph->adj = (uint8 *)(graph->dist + edges);
+
+    for (i = 0; i < galsize; i++) {
+        uint16 e = graph->start[i];
+
+        n = gridwithin(g, grid, g->x[i], g->y[i], range, found, dist);
+        for (k = 0; k < n; k++)
+            if (found[k] != i) {
+                graph->adj[e]  = (uint8)found[k];
+                graph->dist[e] = dist[k];
+                e++;
+            }
+    }
+
+    buildcomponents(graph);
 
     return true;
 }
 
-static boolean
-dolocal(char *s) {
-    planetnum syscount;
-    myuint d;
+static void freecache(cachetype *cache);
 
-    (void)s;
-    (void)printf("Galaxy number %i:", galaxynum);
-    for (syscount = 0; syscount < galsize; ++syscount) {
-        d = distance(galaxy[syscount], galaxy[currentplanet]);
-        if (d <= maxfuel) {
-            if (d <= fuel)
-                (void)printf("\n * ");
-            else
-                (void)printf("\n - ");
+static void
+freegraphs(universetype *u) /* And everything derived from them */
+{
+    int galcount;
+
+    for (galcount = 0; galcount < numgalaxies; galcount++) {
+        free(u->graphs[galcount].dist);
+        u->graphs[galcount].dist = NULL;
+        u->graphs[galcount].adj  = NULL;
+    }
+
+    u->graphrange = 0;
+    freecache(u->cache);
+}
+
+static void
+graphtask(void *u_, int galcount) {
+    universetype *u = (universetype *)u_;
+
+    (void)buildgraph(&u->graphs[galcount], &u->galaxies[galcount], &u->grids[galcount], u->graphrange);
+}
+
+static boolean
+buildgraphs(universetype *u, myuint range)
+/*
+ * (Re)build the jump graphs of all galaxies for
+ * the given range, if not already built for it.
+ * Call again whenever maxfuel changes.
+ */
+{
+    int galcount;
+
+    if ((u->graphrange == range) && (u->graphs[0].dist != NULL))
+        return true;
+
+    freegraphs(u);
+    u->graphrange = range;
+    runparallel(graphtask, u, numgalaxies);
+
+    for (galcount = 0; galcount < numgalaxies; galcount++)
+        if (u->graphs[galcount].dist == NULL) {
+            freegraphs(u);
+
+            return false;
+        }
+
+    return true;
+}
+
+/** Route finding **/
+
+static void
+routetree(const graphtype *graph, planetnum root, int kind, uint8 *next)
+/*
+ * Dijkstra's algorithm outwards from root.  Jump
+ * distances are symmetric, so each system's parent
+ * in the tree is its next hop towards root.  Costs
+ * order by jumps then fuel, or fuel then jumps, in
+ * one number; ties go to the system settled first.
+ */
+{
+    unsigned long cost[galsize];
+    boolean done[galsize];
+    const unsigned long unknown = (unsigned long)-1;
+    planetnum i, u;
+
+    for (i = 0; i < galsize; i++) {
+        cost[i] = unknown;
+        done[i] = false;
+        next[i] = (uint8)i;
+    }
+
+    cost[root] = 0;
+
+    for (;;) {
+        int e;
+
+        u = -1;
+        for (i = 0; i < galsize; i++)
+            if (!done[i] && (cost[i] != unknown) && ((u < 0) || (cost[i] < cost[u])))
+                u = i;
+
+        if (u < 0)
+            break;
+
+        done[u] = true;
+        for (e = graph->start[u]; e < graph->start[u + 1]; e++) {
+            planetnum v     = graph->adj[e];
+            unsigned long c = cost[u] + (kind == hopsroute ? 0x10000UL + graph->dist[e] : 0x100UL * graph->dist[e] + 1);
+
+            if (c < cost[v]) {
+                cost[v] = c;
+                next[v] = (uint8)u;
+            }
+        }
+    }
+}
+
+typedef struct {
+    const graphtype *graph;
+    int kind;
+    routetype *rt;
+} routejob;
+
+static void
+routetask(void *job_, int to) {
+    routejob *job = (routejob *)job_;
+
+    routetree(job->graph, to, job->kind, job->rt->next[to]);
+}
+
+static const routetype *
+getroutes(const contexttype *ctx, int kind)
+/*
+ * Route table of the current galaxy, built on
+ * first use; NULL if out of memory
+ */
+{
+    cachetype *cache = ctx->universe->cache;
+    routetype *rt;
+
+    lock(&cache->lock);
+    rt = cache->routes[ctx->galaxynum - 1][kind];
+    if (rt == NULL) {
+        rt = (routetype *)malloc(sizeof(*rt));
+        if (rt != NULL) {
+            routejob job;
+
+            job.graph = ctx->graph;
+            job.kind  = kind;
+            job.rt    = rt;
+            runparallel(routetask, &job, galsize);
+
+            cache->routes[ctx->galaxynum - 1][kind] = rt;
+        }
+    }
+    unlock(&cache->lock);
+
+    return rt;
+}
+
+static int
+findroute(const contexttype *ctx, planetnum from, planetnum to, int kind, planetnum *path)
+/*
+ * Fill path with the systems from from to to, both
+ * included; returns how many, or 0 if there is no
+ * route.  O(length of route) once the table is built.
+ */
+{
+    const routetype *rt;
+    int n = 0;
+
+    if (ctx->graph->comp[from] != ctx->graph->comp[to])
+        return 0; /* No need to build the table */
+
+    rt = getroutes(ctx, kind);
+    if (rt == NULL)
+        return 0;
+
+    path[n++] = from;
+    while (from != to) {
+        from      = rt->next[to][from];
+        path[n++] = from;
+    }
+
+    return n;
+}
+
+/** Trade planning **/
+
+#define maxplanhops (TXTELITE_MAXPLAN)
+#define planbudget (0.1) /* Seconds of search for the plan command */
+
+typedef struct {
+    myuint amount[lasttrade + 1];
+} cargotype;
+
+typedef struct {
+    int32 cash; /* With cargo sold at the last stop */
+    myuint fuel;
+    boolean valid;
+    uint8 path[maxplanhops + 1];
+} plannode;
+
+static double
+wallclock(void) /* Seconds, for time budgets */
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#endif /* ifdef CLOCK_MONOTONIC */
+
+    return (double)time(NULL);
+}
+
+/*
+ * Choosing cargo is a bounded knapsack with two budgets:
+ * every good costs cash, but only goods sold by the tonne
+ * take hold space.  It is solved exactly by branch and
+ * bound over the goods worth buying, trying the largest
+ * amounts first.  A branch is cut when it cannot beat
+ * the best so far even with fractional amounts, bounded
+ * three ways: ignoring the hold, ignoring cash, and
+ * charging a price lambda per tonne in place of the hold
+ * limit (a Lagrangian bound, lambda chosen at the root).
+ * Goods are branched on in order of profit per credit
+ * after that charge.
+ */
+
+typedef struct {
+    int n;                       /* Goods worth buying */
+    int good[lasttrade + 1];     /* Most profit per credit first */
+    int32 price[lasttrade + 1];  /* By position in good[] */
+    int32 margin[lasttrade + 1];
+    myuint most[lasttrade + 1];  /* In stock */
+    boolean tonnage[lasttrade + 1];
+    int bycash[lasttrade + 1];   /* Positions, most profit per credit first */
+    int nt;
+    int byhold[lasttrade + 1];   /* Positions of tonne goods, most profit per tonne first */
+    int32 lambda;                /* Charge per tonne of hold */
+    int nl;
+    int bylambda[lasttrade + 1]; /* Positions still profitable after the charge, best per credit first */
+    myuint amount[lasttrade + 1]; /* Current branch */
+    myuint bestamount[lasttrade + 1];
+    int32 best;
+} knaptype;
+
+static int32
+knapbound(const knaptype *k, int from, int32 cash, myuint hold)
+/*
+ * Most that goods from position from onwards could add,
+ * as the lesser of the fractional bounds for cash alone
+ * and for hold alone
+ */
+{
+    int32 bycash = 0, byhold = 0;
+    int j;
+
+    for (j = 0; (j < k->n) && (cash > 0); j++) {
+        int g = k->bycash[j];
+        int32 cost;
+
+        if (g < from)
+            continue;
+
+        cost = k->price[g] * (int32)k->most[g];
+        if (cost <= cash) {
+            bycash += k->margin[g] * (int32)k->most[g];
+            cash -= cost;
+        } else {
+            bycash += k->margin[g] * (cash / k->price[g]) + k->margin[g] * (cash % k->price[g]) / k->price[g];
+            cash = 0;
+        }
+    }
+
+    for (j = from; j < k->n; j++)
+        if (!k->tonnage[j])
+            byhold += k->margin[j] * (int32)k->most[j];
+
+    for (j = 0; (j < k->nt) && (hold > 0); j++) {
+        int g = k->byhold[j];
+        myuint a;
+
+        if (g < from)
+            continue;
+
+        a = k->most[g] < hold ? k->most[g] : hold;
+        byhold += k->margin[g] * (int32)a;
+        hold -= a;
+    }
+
+    return bycash < byhold ? bycash : byhold;
+}
+
+static boolean
+knapholdonly(knaptype *k, int32 cash, myuint hold)
+/*
+ * Tonnes all weigh the same, so with cash no object
+ * the best tonnes by margin fill the hold, and every
+ * other good is bought out.  True if that is affordable.
+ */
+{
+    int32 cost = 0, value = 0;
+    int j;
+
+    for (j = 0; j < k->n; j++) k->bestamount[j] = k->tonnage[j] ? 0 : k->most[j];
+
+    for (j = 0; (j < k->nt) && (hold > 0); j++) {
+        int g = k->byhold[j];
+
+        k->bestamount[g] = k->most[g] < hold ? k->most[g] : hold;
+        hold -= k->bestamount[g];
+    }
+
+    for (j = 0; j < k->n; j++) {
+        cost += k->price[j] * (int32)k->bestamount[j];
+        value += k->margin[j] * (int32)k->bestamount[j];
+    }
+
+    if (cost > cash) {
+        (void)memset(k->bestamount, 0, sizeof(k->bestamount));
+
+        return false;
+    }
+
+    k->best = value;
+
+    return true;
+}
+
+static int32
+lambdabound(const knaptype *k, int from, int32 cash, myuint hold, int32 lambda, const int *order, int n)
+/*
+ * lambda*hold, plus the fractional bound for cash
+ * alone with margins less lambda per tonne.  Only
+ * goods in order[0..n-1] have a positive margin then.
+ */
+{
+    int32 bound = lambda * (int32)hold;
+    int j;
+
+    for (j = 0; (j < n) && (cash > 0); j++) {
+        int g       = order[j];
+        int32 gain  = k->margin[g] - (k->tonnage[g] ? lambda : 0);
+        int32 cost;
+
+        if (g < from)
+            continue;
+
+        cost = k->price[g] * (int32)k->most[g];
+        if (cost <= cash) {
+            bound += gain * (int32)k->most[g];
+            cash -= cost;
+        } else {
+            bound += gain * (cash / k->price[g]) + gain * (cash % k->price[g]) / k->price[g];
+            cash = 0;
+        }
+    }
+
+    return bound;
+}
+
+static int
+lambdaorder(const knaptype *k, int32 lambda, int *order)
+/*
+ * Positions with a positive margin after charging
+ * lambda per tonne, best per credit first
+ */
+{
+    int n = 0, i, j;
+
+    for (j = 0; j < k->n; j++) {
+        int32 gain = k->margin[j] - (k->tonnage[j] ? lambda : 0);
+
+        if (gain <= 0)
+            continue;
+
+        for (i = n; i > 0; i--) {
+            int g       = order[i - 1];
+            int32 gaing = k->margin[g] - (k->tonnage[g] ? lambda : 0);
+
+            if (gaing * k->price[j] >= gain * k->price[g])
+                break;
+
+            order[i] = g;
+        }
+        order[i] = j;
+        n++;
+    }
+
+    return n;
+}
+
+static void
+knaplambda(knaptype *k, int32 cash, myuint hold)
+/*
+ * The bound is convex in lambda, so a ternary
+ * search over whole tenths finds its minimum
+ */
+{
+    int32 lo = 0, hi = 0;
+    int j, order[lasttrade + 1];
+
+    for (j = 0; j < k->n; j++)
+        if (k->tonnage[j] && (k->margin[j] > hi))
+            hi = k->margin[j];
+
+    while (hi - lo > 2) {
+        int32 m1 = lo + (hi - lo) / 3, m2 = hi - (hi - lo) / 3;
+
+        if (lambdabound(k, 0, cash, hold, m1, order, lambdaorder(k, m1, order))
+            <= lambdabound(k, 0, cash, hold, m2, order, lambdaorder(k, m2, order)))
+            hi = m2;
+        else
+            lo = m1;
+    }
+
+    k->lambda = lo;
+    for (j = lo + 1; j <= hi; j++)
+        if (lambdabound(k, 0, cash, hold, j, order, lambdaorder(k, j, order))
+            < lambdabound(k, 0, cash, hold, k->lambda, order, lambdaorder(k, k->lambda, order)))
+            k->lambda = j;
+
+    k->nl = lambdaorder(k, k->lambda, k->bylambda);
+}
+
+static void
+knapreorder(knaptype *k)
+/*
+ * Branch in lambda order, which weighs both budgets,
+ * with goods that lambda makes unprofitable last
+ */
+{
+    knaptype old = *k;
+    int where[lasttrade + 1]; /* New position of each old one */
+    int n = 0, i, j;
+
+    for (j = 0; j < old.nl; j++) where[old.bylambda[j]] = n++;
+    for (j = 0; j < old.n; j++) {
+        for (i = 0; (i < old.nl) && (old.bylambda[i] != j); i++)
+            ;
+        if (i == old.nl)
+            where[j] = n++;
+    }
+
+    for (j = 0; j < old.n; j++) {
+        k->good[where[j]]    = old.good[j];
+        k->price[where[j]]   = old.price[j];
+        k->margin[where[j]]  = old.margin[j];
+        k->most[where[j]]    = old.most[j];
+        k->tonnage[where[j]] = old.tonnage[j];
+    }
+
+    for (j = 0; j < old.n; j++) k->bycash[j] = where[old.bycash[j]];
+    for (j = 0; j < old.nt; j++) k->byhold[j] = where[old.byhold[j]];
+    for (j = 0; j < old.nl; j++) k->bylambda[j] = where[old.bylambda[j]];
+}
+
+static void
+knapsearch(knaptype *k, int j, int32 cash, myuint hold, int32 value)
+/*
+ * Capping good j at a only lowers the bound, so the
+ * first amount whose bound fails ends the loop
+ */
+{
+    myuint stock = k->most[j];
+    int32 a, most;
+
+    if (value > k->best) {
+        k->best = value;
+        (void)memcpy(k->bestamount, k->amount, sizeof(k->amount));
+    }
+
+    if (j == k->n)
+        return;
+
+    most = stock;
+    if ((k->price[j] > 0) && (cash / k->price[j] < most))
+        most = cash / k->price[j];
+    if (k->tonnage[j] && ((int32)hold < most))
+        most = hold;
+
+    for (a = most; a >= 0; a--) {
+        k->most[j] = (myuint)a;
+        if ((value + knapbound(k, j, cash, hold) <= k->best)
+            || (value + lambdabound(k, j, cash, hold, k->lambda, k->bylambda, k->nl) <= k->best))
+            break;
+
+        k->amount[j] = (myuint)a;
+        knapsearch(k, j + 1, cash - a * k->price[j], (myuint)(hold - (k->tonnage[j] ? a : 0)), value + a * k->margin[j]);
+    }
+
+    k->most[j]   = stock;
+    k->amount[j] = 0;
+}
+
+static int32
+choosecargo(const markettype *here, const markettype *there, int32 cash, myuint hold, cargotype *cargo)
+/*
+ * Most profitable cargo to buy here and sell there,
+ * within cash and hold; returns the profit.  Cash
+ * alone seldom binds, and then there is no search.
+ */
+{
+    knaptype k;
+    int i, j;
+
+    k.n  = 0;
+    k.nt = 0;
+    for (i = 0; i <= lasttrade; i++)
+        if ((there->price[i] > here->price[i]) && (here->quantity[i] > 0)) {
+            int32 price  = here->price[i];
+            int32 margin = there->price[i] - price;
+
+            /* Insert by margin/price, cross multiplied */
+            for (j = k.n; (j > 0) && (k.margin[j - 1] * price < margin * k.price[j - 1]); j--) {
+                k.good[j]    = k.good[j - 1];
+                k.price[j]   = k.price[j - 1];
+                k.margin[j]  = k.margin[j - 1];
+                k.most[j]    = k.most[j - 1];
+                k.tonnage[j] = k.tonnage[j - 1];
+            }
+            k.good[j]    = i;
+            k.price[j]   = price;
+            k.margin[j]  = margin;
+            k.most[j]    = here->quantity[i];
+            k.tonnage[j] = commodities[i].units == tonnes;
+            k.n++;
+        }
+
+    for (j = 0; j < k.n; j++) k.bycash[j] = j;
+
+    for (j = 0; j < k.n; j++)
+        if (k.tonnage[j]) {
+            for (i = k.nt; (i > 0) && (k.margin[k.byhold[i - 1]] < k.margin[j]); i--) k.byhold[i] = k.byhold[i - 1];
+            k.byhold[i] = j;
+            k.nt++;
+        }
+
+    (void)memset(k.amount, 0, sizeof(k.amount));
+    (void)memset(k.bestamount, 0, sizeof(k.bestamount));
+    k.best = 0;
+    if ((cash > 0) && !knapholdonly(&k, cash, hold)) {
+        knaplambda(&k, cash, hold);
+        knapreorder(&k);
+        knapsearch(&k, 0, cash, hold, 0);
+    }
+
+    (void)memset(cargo, 0, sizeof(*cargo));
+    for (j = 0; j < k.n; j++) cargo->amount[k.good[j]] = k.bestamount[j];
+
+    return k.best;
+}
+
+static const markettype *
+planmarket(const contexttype *ctx, planetnum p, int level)
+/*
+ * The market at the start of a plan is the one in
+ * front of us; later ones are typical for their economy
+ */
+{
+    if (level == 0)
+        return &ctx->localmarket;
+
+    return &ctx->universe->markets.typical[ctx->galaxy->economy[p]];
+}
+
+static boolean
+planstep(const contexttype *ctx, myuint hold, const plannode *from, int level, planetnum to, myuint d, plannode *out,
+         cargotype *cargo)
+/*
+ * Top up fuel for a jump of d, buy cargo to sell at
+ * to, and jump; false if the fuel is unaffordable
+ */
+{
+    planetnum here = from->path[level];
+    int32 cash     = from->cash;
+    myuint fuel    = from->fuel;
+
+    if (fuel < d) {
+        cash -= fuelcost * (d - fuel);
+        fuel = d;
+        if (cash < 0)
+            return false;
+    }
+
+    cash += choosecargo(planmarket(ctx, here, level), planmarket(ctx, to, level + 1), cash, hold, cargo);
+
+    *out                 = *from;
+    out->cash            = cash;
+    out->fuel            = fuel - d;
+    out->path[level + 1] = (uint8)to;
+
+    return true;
+}
+
+static long
+planscore(const plannode *n) /* Fuel in the tank is worth what it cost */
+{
+    return (long)n->cash + (long)n->fuel * fuelcost;
+}
+
+typedef struct {
+    const contexttype *ctx;
+    myuint hold;
+    int level;         /* Jumps made by the beam so far */
+    const plannode *beam;
+    const int *first;  /* Children of beam[i] start at next[first[i]] */
+    plannode *next;
+} planjob;
+
+static void
+plantask(void *job_, int b) /* Expand one node of the beam */
+{
+    const planjob *job     = (const planjob *)job_;
+    const graphtype *graph = job->ctx->graph;
+    planetnum here         = job->beam[b].path[job->level];
+    plannode *out          = &job->next[job->first[b]];
+    cargotype cargo;
+    int e;
+
+    for (e = graph->start[here]; e < graph->start[here + 1]; e++, out++)
+        out->valid = planstep(job->ctx, job->hold, &job->beam[b], job->level, graph->adj[e], graph->dist[e], out, &cargo);
+}
+
+static int
+planorder(const void *a_, const void *b_) /* Best score first, ties by path */
+{
+    const plannode *a = (const plannode *)a_;
+    const plannode *b = (const plannode *)b_;
+    long sa = planscore(a), sb = planscore(b);
+
+    if (sa != sb)
+        return sa > sb ? -1 : 1;
+
+    return memcmp(a->path, b->path, sizeof(a->path));
+}
+
+static int
+plansearch(const contexttype *ctx, int hops, int32 cash, myuint hold, int width, double deadline, plannode *best,
+           boolean *truncated)
+/*
+ * Beam search, one level per jump.  Of the nodes that
+ * end a level at the same system only the best is kept,
+ * then the best width of those go on to the next level.
+ * Returns the jumps in the best plan found, or -1 if the
+ * deadline (if nonzero) passed first.
+ */
+{
+    const graphtype *graph = ctx->graph;
+    plannode beam[galsize];
+    int first[galsize + 1];
+    int bestat[galsize];
+    int n = 1, level, i;
+    planjob job;
+
+    (void)memset(&beam[0], 0, sizeof(beam[0]));
+    beam[0].cash    = cash;
+    beam[0].fuel    = ctx->fuel;
+    beam[0].valid   = true;
+    beam[0].path[0] = (uint8)ctx->currentplanet;
+    *truncated      = false;
+
+    for (level = 0; level < hops; level++) {
+        plannode *next;
+        int m = 0;
+
+        first[0] = 0;
+        for (i = 0; i < n; i++) first[i + 1] = first[i] + graph->start[beam[i].path[level] + 1] - graph->start[beam[i].path[level]];
+
+        if (first[n] == 0)
+            break; /* Nowhere to go */
+
+        next = (plannode *)malloc((size_t)first[n] * sizeof(*next));
+        if (next == NULL)
+            break;
+
+        job.ctx   = ctx;
+        job.hold  = hold;
+        job.level = level;
+        job.beam  = beam;
+        job.first = first;
+        job.next  = next;
+        runparallel(plantask, &job, n);
+
+        for (i = 0; i < galsize; i++) bestat[i] = -1;
+        for (i = 0; i < first[n]; i++)
+            if (next[i].valid) {
+                planetnum to = next[i].path[level + 1];
+
+                if ((bestat[to] < 0) || (planscore(&next[i]) > planscore(&next[bestat[to]])))
+                    bestat[to] = i;
+            }
+
+        for (i = 0; i < galsize; i++)
+            if (bestat[i] >= 0)
+                beam[m++] = next[bestat[i]];
+
+        free(next);
+
+        if (m == 0)
+            break; /* Cannot afford to go on */
+
+        qsort(beam, (size_t)m, sizeof(beam[0]), planorder);
+        if (m > width) {
+            m          = width;
+            *truncated = true;
+        }
+
+        n = m;
+        if ((deadline > 0) && (wallclock() > deadline))
+            return -1;
+    }
+
+    *best = beam[0];
+
+    return level;
+}
+
+static int
+plantrade(const contexttype *ctx, int hops, int32 cash, myuint hold, double budget, plannode *best, int *width)
+/*
+ * Anytime search: beams of doubling width until the
+ * time budget runs out, or a beam was never full, in
+ * which case a wider one would find nothing better.
+ * The narrowest search always runs to the end.
+ */
+{
+    double deadline = wallclock() + budget;
+    int w, jumps = 0;
+
+    if (hops > maxplanhops)
+        hops = maxplanhops;
+
+    (void)memset(best, 0, sizeof(*best)); /* Staying put, should no search finish */
+    best->cash    = cash;
+    best->fuel    = ctx->fuel;
+    best->valid   = true;
+    best->path[0] = (uint8)ctx->currentplanet;
+    *width        = 0;
+
+    for (w = 8; w <= galsize; w *= 2) {
+        plannode n;
+        boolean truncated;
+        int got = plansearch(ctx, hops, cash, hold, w, w == 8 ? 0 : deadline, &n, &truncated);
+
+        if (got < 0)
+            break;
+
+        *best  = n;
+        *width = w;
+        jumps  = got;
+        if (!truncated || (wallclock() > deadline))
+            break;
+    }
+
+    return jumps;
+}
+
+/** Descriptions **/
+
+typedef struct {
+    const souptype *soup;
+    const galaxytype *g;
+    char (*text)[desclen]; /* One per system */
+    uint16 *len;
+} descjob;
+
+static void
+desctask(void *job_, int i) {
+    descjob *job = (descjob *)job_;
+    size_t len   = describesys(job->soup, job->g, i, job->text[i], desclen);
+
+    job->len[i] = (uint16)(len < desclen ? len : desclen - 1);
+}
+
+static const desctable *
+getdescs(const contexttype *ctx)
+/*
+ * Descriptions of the current galaxy, generated in
+ * parallel on first use; NULL if out of memory
+ */
+{
+    cachetype *cache = ctx->universe->cache;
+    desctable *dt;
+
+    lock(&cache->lock);
+    dt = cache->descs[ctx->galaxynum - 1];
+    if (dt == NULL) {
+        descjob job;
+
+        job.soup = &ctx->universe->soup;
+        job.g    = ctx->galaxy;
+        job.text = (char(*)[desclen])malloc(galsize * (sizeof(*job.text) + sizeof(*job.len)));
+        if (job.text != NULL) {
+            size_t total = 0;
+            planetnum i;
+
+            job.len = (uint16 *)(job.text + galsize);
+            runparallel(desctask, &job, galsize);
+
+            for (i = 0; i < galsize; i++) total += job.len[i];
+
+            dt = (desctable *)malloc(sizeof(*dt) + total);
+            if (dt != NULL) {
+                char *text = (char *)(dt + 1);
+
+                dt->text      = text;
+                dt->offset[0] = 0;
+                for (i = 0; i < galsize; i++) {
+                    (void)memcpy(text + dt->offset[i], job.text[i], job.len[i]);
+                    dt->offset[i + 1] = (uint16)(dt->offset[i] + job.len[i]);
+                }
+
+                cache->descs[ctx->galaxynum - 1] = dt;
+            }
+
+            free(job.text);
+        }
+    }
+    unlock(&cache->lock);
+
+    return dt;
+}
+
+static const char *
+cacheddesc(const contexttype *ctx, planetnum i, size_t *len)
+/*
+ * Description of system i in the current galaxy, not
+ * terminated, and its length in *len; NULL if out of
+ * memory
+ */
+{
+    const desctable *dt = getdescs(ctx);
+
+    if (dt == NULL)
+        return NULL;
+
+    *len = (size_t)(dt->offset[i + 1] - dt->offset[i]);
+
+    return dt->text + dt->offset[i];
+}
+
+/** Arbitrage **/
+
+typedef struct {
+    const galaxytype *g;
+    const marketcube *markets;
+    myuint range;
+    arbtype *arb;
+} arbjob;
+
+static void
+arbtask(void *job_, int a) /* One row: from system a to every other */
+{
+    const arbjob *job    = (const arbjob *)job_;
+    const galaxytype *g  = job->g;
+    const uint16 *profit = job->markets->arbprofit[g->economy[a]];
+    const uint8 *good    = job->markets->arbgood[g->economy[a]];
+    uint16 *row          = job->arb->profit[a];
+    uint8 *goods         = job->arb->good[a];
+    myuint d[galsize];
+    int b;
+
+    distances(g, a, d);
+    for (b = 0; b < galsize; b++) {
+        uint8 e  = g->economy[b];
+        row[b]   = (uint16)(((d[b] <= job->range) && (b != a)) ? profit[e] : 0);
+        goods[b] = good[e];
+    }
+}
+
+static const arbtype *
+getarbs(const contexttype *ctx)
+/*
+ * Arbitrage matrix of the current galaxy, built
+ * on first use; NULL if out of memory
+ */
+{
+    cachetype *cache = ctx->universe->cache;
+    arbtype *arb;
+
+    lock(&cache->lock);
+    arb = cache->arbs[ctx->galaxynum - 1];
+    if (arb == NULL) {
+        arb = (arbtype *)malloc(sizeof(*arb));
+        if (arb != NULL) {
+            arbjob job;
+
+            job.g       = ctx->galaxy;
+            job.markets = &ctx->universe->markets;
+            job.range   = ctx->universe->graphrange;
+            job.arb     = arb;
+            runparallel(arbtask, &job, galsize);
+
+            cache->arbs[ctx->galaxynum - 1] = arb;
+        }
+    }
+    unlock(&cache->lock);
+
+    return arb;
+}
+
+static void
+freecache(cachetype *cache) /* Everything built on demand */
+{
+    int galcount, kind;
+
+    if (cache == NULL)
+        return;
+
+    for (galcount = 0; galcount < numgalaxies; galcount++) {
+        for (kind = 0; kind < 2; kind++) {
+            free(cache->routes[galcount][kind]);
+            cache->routes[galcount][kind] = NULL;
+        }
+
+        free(cache->arbs[galcount]);
+        cache->arbs[galcount] = NULL;
+
+        free(cache->descs[galcount]);
+        cache->descs[galcount] = NULL;
+    }
+}
+
+/** Universe **/
+
+static boolean
+builduniverse(universetype *u)
+/*
+ * Galaxies are either compiled into the binary or built
+ * once up front, and are never written to again; false
+ * if out of memory or the templates outgrow soupsize
+ */
+{
+#ifdef TXTELITE_PREBUILT
+    u->galaxies = prebuiltgalaxies;
+#else
+    buildgalaxies(u->built);
+    u->galaxies = (const galaxytype *)u->built;
+#endif /* ifdef TXTELITE_PREBUILT */
+
+    runparallel(gridtask, u, numgalaxies);
+    genmarkets(&u->markets);
+    if (!compilesoup(&u->soup))
+        return false;
+
+    u->cache = (cachetype *)calloc(1, sizeof(*u->cache));
+    if (u->cache == NULL)
+        return false;
+
+    initlock(&u->cache->lock);
+
+    (void)memset(u->graphs, 0, sizeof(u->graphs));
+    u->graphrange = 0;
+
+    if (buildgraphs(u, (myuint)maxfuel))
+        return true;
+
+    freelock(&u->cache->lock);
+    free(u->cache);
+
+    return false;
+}
+
+static void
+freeuniverse(universetype *u) {
+    freegraphs(u);
+    freelock(&u->cache->lock);
+    free(u->cache);
+}
+
+/** Game setup **/
+
+static void
+initcontext(contexttype *ctx, const universetype *u, boolean native)
+/*
+ * Fresh commander at Lave in galaxy one, on libc's
+ * generator if native, which reseeds it for the whole
+ * process, else on the weak one
+ */
+{
+    (void)memset(ctx, 0, sizeof(*ctx));
+
+    ctx->universe   = u;
+    ctx->nativerand = (native != 0);
+
+    mysrand(ctx, 12345); /* Ensure repeatability */
+
+    gamegalaxy(ctx, 1);
+
+    ctx->currentplanet = numforLave; /* Don't use jump */
+    getmarket(&ctx->localmarket, &u->markets, 0x00, ctx->galaxy->economy[numforLave]); /* Since want seed=0 */
+
+    ctx->fuel = (myuint)maxfuel;
+}
+
+/** Snapshots **/
+
+static void
+splitcash(int32 cash, unsigned int *lo, unsigned int *hi) /* Whatever the width of int32 */
+{
+    unsigned long u = (unsigned long)cash;
+
+    *lo = (unsigned int)(u & 0xFFFFFFFFUL);
+    if (sizeof(int32) > 4)
+        *hi = (unsigned int)(((u >> 16) >> 16) & 0xFFFFFFFFUL);
+    else
+        *hi = (cash < 0) ? 0xFFFFFFFFU : 0;
+}
+
+static boolean
+joincash(unsigned int lo, unsigned int hi, int32 *cash) /* As split; false if int32 cannot hold it */
+{
+    unsigned long u = lo, m = 0xFFFFFFFFUL; /* The bits, and those int32 has */
+
+    if (sizeof(int32) > 4) {
+        u |= ((unsigned long)hi << 16) << 16;
+        m = ~0UL;
+    } else if (hi != ((lo & 0x80000000U) ? 0xFFFFFFFFU : 0)) {
+        return false;
+    }
+
+    if (hi & 0x80000000U)
+        *cash = -(int32)(~u & m) - 1; /* Negative, without overflow */
+    else
+        *cash = (int32)u;
+
+    return true;
+}
+
+static void
+savesnapshot(const contexttype *ctx, snapshottype *snap)
+/*
+ * libc's random state cannot be saved, so a commander
+ * using it resumes from wherever libc's stream is then
+ */
+{
+    snap->magic         = snapmagic;
+    snap->lastrand      = ctx->rng.lastrand;
+    snap->galaxynum     = ctx->galaxynum;
+    snap->currentplanet = (uint16)ctx->currentplanet;
+    snap->fuel          = ctx->fuel;
+    snap->holdspace     = ctx->holdspace;
+    snap->flags         = (uint16)((ctx->nativerand ? snapnative : 0) | (ctx->quit ? snapquit : 0));
+    (void)memcpy(snap->shipshold, ctx->shipshold, sizeof(snap->shipshold));
+    snap->localmarket = ctx->localmarket;
+    splitcash(ctx->cash, &snap->cashlo, &snap->cashhi);
+}
+
+static boolean
+loadsnapshot(contexttype *ctx, const snapshottype *snap)
+/*
+ * Resume from snap; false, leaving ctx alone, if
+ * snap is not a snapshot from this byte order, or
+ * holds more cash than int32 can
+ */
+{
+    int32 cash;
+
+    if ((snap->magic != snapmagic) || (snap->galaxynum < 1) || (snap->galaxynum > numgalaxies)
+        || (snap->currentplanet >= galsize) || (snap->flags & ~(snapnative | snapquit))
+        || !joincash(snap->cashlo, snap->cashhi, &cash))
+        return false;
+
+    gamegalaxy(ctx, snap->galaxynum);
+    ctx->rng.lastrand  = snap->lastrand;
+    ctx->cash          = cash;
+    ctx->currentplanet = snap->currentplanet;
+    ctx->fuel          = snap->fuel;
+    ctx->holdspace     = snap->holdspace;
+    ctx->nativerand    = (snap->flags & snapnative) != 0; /* As rand toggles it */
+    ctx->quit          = (snap->flags & snapquit) ? true : false;
+    (void)memcpy(ctx->shipshold, snap->shipshold, sizeof(ctx->shipshold));
+    ctx->localmarket = snap->localmarket;
+
+    return true;
+}
+
+/** Simulation **/
+
+/*
+ * Commanders start as in the text interface (Lave, a 20t
+ * hold, 100 CR) and each draws from its own weak random
+ * stream.  The generator's period is shared out evenly:
+ * commander k's stream starts where the stream seeded
+ * with the run's seed would be after k*stride draws, so
+ * a commander depends only on the seed, its number and
+ * the number of commanders, and no two streams overlap.
+ * At every stop the policy buys cargo and names the next
+ * system; the simulator buys the fuel, jumps, and sells
+ * everything.  A commander stops early if it cannot move,
+ * or if the jump would draw past the end of its stream.
+ */
+
+typedef struct {
+    const universetype *u;
+    unsigned long stride; /* Draws in each stream */
+    int jumps;
+    txtelite_policy policy;
+    void *arg;
+    unsigned long seed;
+    long *profits;
+    unsigned int *made;
+} simjob;
+
+static int32
+fuelfor(const contexttype *ctx, planetnum dest) /* Cost of topping up to reach dest */
+{
+    myuint d = distance(ctx->galaxy, ctx->currentplanet, dest);
+
+    return d > ctx->fuel ? (int32)fuelcost * (d - ctx->fuel) : 0;
+}
+
+static int32
+cargofor(contexttype *ctx, planetnum dest, boolean buy)
+/*
+ * Profit, less fuel, of the best cargo for dest,
+ * keeping back the fuel money; buys it if buy
+ */
+{
+    int32 fuel = fuelfor(ctx, dest);
+    int32 profit;
+    cargotype cargo;
+    myuint i;
+
+    if (fuel > ctx->cash)
+        return -1;
+
+    profit = choosecargo(&ctx->localmarket, &ctx->universe->markets.typical[ctx->galaxy->economy[dest]], ctx->cash - fuel,
+                         ctx->holdspace, &cargo);
+    if (buy)
+        for (i = 0; i <= lasttrade; i++)
+            if (cargo.amount[i] > 0)
+                (void)gamebuy(ctx, i, cargo.amount[i]);
+
+    return profit - fuel;
+}
+
+static int
+policyrandom(contexttype *ctx) /* Any system in range, with the best cargo for it */
+{
+    const graphtype *graph = ctx->graph;
+    int degree             = graph->start[ctx->currentplanet + 1] - graph->start[ctx->currentplanet];
+    planetnum dest;
+
+    if (degree == 0)
+        return -1;
+
+    dest = graph->adj[graph->start[ctx->currentplanet] + myrand(ctx) % degree];
+    (void)cargofor(ctx, dest, true);
+
+    return dest;
+}
+
+static int
+policygreedy(contexttype *ctx) /* The system in range with the most profitable cargo */
+{
+    const graphtype *graph = ctx->graph;
+    int32 best             = -1;
+    planetnum dest         = -1;
+    int e;
+
+    for (e = graph->start[ctx->currentplanet]; e < graph->start[ctx->currentplanet + 1]; e++) {
+        int32 profit = cargofor(ctx, graph->adj[e], false);
+
+        if (profit > best) {
+            best = profit;
+            dest = graph->adj[e];
+        }
+    }
+
+    if (dest >= 0)
+        (void)cargofor(ctx, dest, true);
+
+    return dest;
+}
+
+static void
+simtask(void *job_, int k) /* Commander k */
+{
+    const simjob *job = (const simjob *)job_;
+    contexttype ctx;
+    int32 start;
+    unsigned int made = 0;
+    myuint i;
+
+    initcontext(&ctx, job->u, false); /* libc's generator is never touched */
+    mysrand(&ctx, (unsigned int)job->seed);
+    rngskip(&ctx.rng, (unsigned long)k * job->stride);
+    (void)gamehold(&ctx, 20);
+    ctx.cash += 1000;
+    start = ctx.cash;
+
+    while (made < (unsigned int)job->jumps) {
+        int dest = job->policy(&ctx, job->arg);
+
+        if ((dest < 0) || (dest >= galsize) || (dest == ctx.currentplanet) || (ctx.draws >= job->stride))
+            break; /* The jump draws one more */
+
+        if (fuelfor(&ctx, dest) > 0)
+            (void)gamefuel(&ctx, distance(ctx.galaxy, ctx.currentplanet, dest) - ctx.fuel);
+
+        if (gamehyperjump(&ctx, dest) != TXTELITE_OK)
+            break;
+
+        made++;
+        for (i = 0; i <= lasttrade; i++)
+            if (ctx.shipshold[i] > 0)
+                (void)gamesell(&ctx, i, ctx.shipshold[i]);
+    }
+
+    for (i = 0; i <= lasttrade; i++) /* Anything bought for a jump not made */
+        if (ctx.shipshold[i] > 0)
+            (void)gamesell(&ctx, i, ctx.shipshold[i]);
+
+    job->profits[k] = ctx.cash - start;
+    if (job->made != NULL)
+        job->made[k] = made;
+}
+
+/** Library interface (see txtelite.h) **/
+
+txtelite_universe *
+txtelite_universe_new(void) {
+    universetype *u = (universetype *)malloc(sizeof(*u));
+
+    if ((u != NULL) && !builduniverse(u)) {
+        free(u);
+        u = NULL;
+    }
+
+    return u;
+}
+
+void
+txtelite_universe_free(txtelite_universe *u) {
+    if (u != NULL)
+        freeuniverse(u);
+
+    free(u);
+}
+
+txtelite *
+txtelite_new(const txtelite_universe *u) {
+    contexttype *ctx = (contexttype *)malloc(sizeof(*ctx));
+
+    if (ctx != NULL)
+        initcontext(ctx, u, false);
+
+    return ctx;
+}
+
+void
+txtelite_free(txtelite *t) {
+    free(t);
+}
+
+void
+txtelite_status_get(const txtelite *t, txtelite_status *st) {
+    myuint i;
+
+    st->galaxy    = t->galaxynum;
+    st->planet    = t->currentplanet;
+    st->cash      = t->cash;
+    st->fuel      = t->fuel;
+    st->holdspace = t->holdspace;
+    st->quit      = t->quit != false;
+    for (i = 0; i <= lasttrade; i++) st->hold[i] = t->shipshold[i];
+}
+
+void
+txtelite_market_get(const txtelite *t, txtelite_market *m) {
+    myuint i;
+
+    for (i = 0; i <= lasttrade; i++) {
+        m->price[i]    = t->localmarket.price[i];
+        m->quantity[i] = t->localmarket.quantity[i];
+    }
+}
+
+int
+txtelite_market_at(const txtelite *t, int planet, unsigned int fluct, txtelite_market *m) {
+    markettype market;
+    myuint i;
+
+    if ((planet < 0) || (planet >= galsize))
+        return TXTELITE_BADPLANET;
+
+    getmarket(&market, &t->universe->markets, (myuint)fluct, t->galaxy->economy[planet]);
+    for (i = 0; i <= lasttrade; i++) {
+        m->price[i]    = market.price[i];
+        m->quantity[i] = market.quantity[i];
+    }
+
+    return TXTELITE_OK;
+}
+
+static void
+copysystem(txtelite_system *sys, const plansys *p) {
+    (void)memcpy(sys->name, p->name, sizeof(sys->name));
+    sys->x            = p->x;
+    sys->y            = p->y;
+    sys->economy      = p->economy;
+    sys->govtype      = p->govtype;
+    sys->techlev      = p->techlev;
+    sys->population   = p->population;
+    sys->productivity = p->productivity;
+    sys->radius       = p->radius;
+    sys->human_colony = p->human_colony;
+    sys->species_type = p->species_type;
+    sys->species_adj1 = p->species_adj1;
+    sys->species_adj2 = p->species_adj2;
+    sys->species_adj3 = p->species_adj3;
+}
+
+int
+txtelite_system_get(const txtelite *t, int planet, txtelite_system *sys) {
+    plansys p;
+
+    if ((planet < 0) || (planet >= galsize))
+        return TXTELITE_BADPLANET;
+
+    p = unpacksystem(t->galaxy, planet);
+    copysystem(sys, &p);
+
+    return TXTELITE_OK;
+}
+
+int
+txtelite_generate(unsigned int galaxy, int planet, txtelite_system *sys)
+/*
+ * Needs no universe; costs one system's generation
+ */
+{
+    plansys p;
+
+    if ((galaxy < 1) || (galaxy > numgalaxies) || (planet < 0) || (planet >= galsize))
+        return TXTELITE_BADPLANET;
+
+    p = getsystem((myuint)galaxy, planet);
+    copysystem(sys, &p);
+
+    return TXTELITE_OK;
+}
+
+int
+txtelite_find(const txtelite *t, const char *name)
+/*
+ * Nearest system whose name begins with name,
+ * or the current system if none does
+ */
+{
+    return matchsys(t, name, strlen(name));
+}
+
+unsigned int
+txtelite_distance(const txtelite *t, int a, int b) {
+    if ((a < 0) || (a >= galsize) || (b < 0) || (b >= galsize))
+        return 0;
+
+    return distance(t->galaxy, a, b);
+}
+
+void
+txtelite_distances(const txtelite *t, int planet, unsigned int *out) {
+    myuint d[galsize];
+    planetnum i;
+
+    if ((planet < 0) || (planet >= galsize))
+        planet = t->currentplanet;
+
+    distances(t->galaxy, planet, d);
+    for (i = 0; i < galsize; i++) out[i] = d[i];
+}
+
+static int
+copyfound(const planetnum *p, const myuint *d, int n, int *out, unsigned int *dist) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = p[i];
+        if (dist != NULL)
+            dist[i] = d[i];
+    }
+
+    return n;
+}
+
+int
+txtelite_within(const txtelite *t, int planet, unsigned int range, int *out, unsigned int *dist) {
+    planetnum p[galsize];
+    myuint d[galsize];
+
+    if ((planet < 0) || (planet >= galsize))
+        planet = t->currentplanet;
+
+    return copyfound(p, d, gridwithin(t->galaxy, t->grid, t->galaxy->x[planet], t->galaxy->y[planet], range, p, d), out,
+                     dist);
+}
+
+int
+txtelite_route(const txtelite *t, int from, int to, int kind, int *out, int len) {
+    planetnum path[galsize];
+    int n, i;
+
+    if ((from < 0) || (from >= galsize) || (to < 0) || (to >= galsize))
+        return TXTELITE_BADPLANET;
+
+    n = findroute(t, from, to, kind == TXTELITE_FUEL ? fuelroute : hopsroute, path);
+    for (i = 0; (i < n) && (i < len); i++) out[i] = path[i];
+
+    return n;
+}
+
+int
+txtelite_component(const txtelite *t, int planet, unsigned int *size) {
+    if ((planet < 0) || (planet >= galsize))
+        return TXTELITE_BADPLANET;
+
+    if (size != NULL)
+        *size = t->graph->compsize[t->graph->comp[planet]];
+
+    return t->graph->comp[planet];
+}
+
+int
+txtelite_reachable(const txtelite *t, int a, int b) {
+    if ((a < 0) || (a >= galsize) || (b < 0) || (b >= galsize))
+        return TXTELITE_BADPLANET;
+
+    return t->graph->comp[a] == t->graph->comp[b];
+}
+
+int
+txtelite_plan(const txtelite *t, int hops, long cash, unsigned int hold, unsigned int budget_ms, int *path,
+              long *final) {
+    plannode best;
+    int width, jumps, i;
+
+    if (hops < 0)
+        hops = 0;
+
+    jumps = plantrade(t, hops, (int32)cash, (myuint)hold, (double)budget_ms / 1000, &best, &width);
+    for (i = 0; i <= jumps; i++) path[i] = best.path[i];
+
+    if (final != NULL)
+        *final = best.cash;
+
+    return jumps;
+}
+
+int
+txtelite_bestbuy(const txtelite *t, int dest, unsigned int *amounts, long *profit) {
+    cargotype cargo;
+    int32 p;
+    myuint i;
+
+    if ((dest < 0) || (dest >= galsize))
+        return TXTELITE_BADPLANET;
+
+    p = choosecargo(&t->localmarket, &t->universe->markets.typical[t->galaxy->economy[dest]], t->cash, t->holdspace,
+                    &cargo);
+    for (i = 0; i <= lasttrade; i++) amounts[i] = cargo.amount[i];
+
+    if (profit != NULL)
+        *profit = p;
+
+    return TXTELITE_OK;
+}
+
+int
+txtelite_arb(const txtelite *t, int from, int to, int *good) {
+    const arbtype *arb;
+
+    if ((from < 0) || (from >= galsize) || (to < 0) || (to >= galsize))
+        return TXTELITE_BADPLANET;
+
+    arb = getarbs(t);
+    if ((arb == NULL) || (arb->profit[from][to] == 0))
+        return 0;
+
+    if (good != NULL)
+        *good = arb->good[from][to];
+
+    return arb->profit[from][to];
+}
+
+int
+txtelite_near(const txtelite *t, int x, int y, int k, int *out, unsigned int *dist) {
+    planetnum p[galsize];
+    myuint d[galsize];
+
+    if (k <= 0)
+        return 0;
+
+    return copyfound(p, d, gridnearest(t->galaxy, t->grid, clampmap(x), clampmap(y), k, p, d), out, dist);
+}
+
+size_t
+txtelite_describe(const txtelite *t, int planet, char *buf, size_t len) {
+    const char *text;
+    size_t full;
+
+    if ((planet < 0) || (planet >= galsize)) {
+        if (len > 0)
+            buf[0] = '\0';
+
+        return 0;
+    }
+
+    text = cacheddesc(t, planet, &full);
+    if (text == NULL)
+        return describesys(&t->universe->soup, t->galaxy, planet, buf, len);
+
+    if (len > 0) {
+        size_t n = (full < len) ? full : len - 1;
+
+        (void)memcpy(buf, text, n);
+        buf[n] = '\0';
+    }
+
+    return full;
+}
+
+size_t
+txtelite_species(const txtelite *t, int planet, char *buf, size_t len) {
+    if ((planet < 0) || (planet >= galsize)) {
+        if (len > 0)
+            buf[0] = '\0';
+
+        return 0;
+    }
+
+    return describespecies(t->galaxy, planet, buf, len);
+}
+
+const char *
+txtelite_economy_name(unsigned int economy) {
+    return economy < 8 ? econnames[economy] : NULL;
+}
+
+const char *
+txtelite_government_name(unsigned int govtype) {
+    return govtype < 8 ? govnames[govtype] : NULL;
+}
+
+const char *
+txtelite_unit_name(unsigned int units) {
+    return units < 3 ? unitnames[units] : NULL;
+}
+
+const char *
+txtelite_good_name(int good) {
+    if ((good < 0) || (good > lasttrade))
+        return NULL;
+
+    return commodities[good].name;
+}
+
+unsigned int
+txtelite_good_units(int good) {
+    if ((good < 0) || (good > lasttrade))
+        return tonnes;
+
+    return commodities[good].units;
+}
+
+void
+txtelite_seed(txtelite *t, unsigned int seed, int native) {
+    t->nativerand = native != 0;
+    mysrand(t, seed);
+}
+
+unsigned int
+txtelite_buy(txtelite *t, int good, unsigned int amount) {
+    if ((good < 0) || (good > lasttrade))
+        return 0;
+
+    return gamebuy(t, (myuint)good, (myuint)amount);
+}
+
+unsigned int
+txtelite_sell(txtelite *t, int good, unsigned int amount) {
+    if ((good < 0) || (good > lasttrade))
+        return 0;
+
+    return gamesell(t, (myuint)good, (myuint)amount);
+}
+
+unsigned int
+txtelite_fuel(txtelite *t, unsigned int amount) {
+    return gamefuel(t, (myuint)amount);
+}
+
+int
+txtelite_jump(txtelite *t, int planet) {
+    if ((planet < 0) || (planet >= galsize))
+        return TXTELITE_BADPLANET;
+
+    return gamehyperjump(t, planet);
+}
+
+int
+txtelite_sneak(txtelite *t, int planet) {
+    if ((planet < 0) || (planet >= galsize))
+        return TXTELITE_BADPLANET;
+
+    return gamesneak(t, planet);
+}
+
+void
+txtelite_galhyp(txtelite *t) {
+    gamegalhyp(t);
+}
+
+int
+txtelite_hold(txtelite *t, unsigned int tonnes_) {
+    return gamehold(t, (myuint)tonnes_) ? TXTELITE_OK : TXTELITE_HOLDFULL;
+}
+
+void
+txtelite_cash(txtelite *t, long amount) {
+    t->cash += amount;
+}
+
+void
+txtelite_quit(txtelite *t) {
+    t->quit = true;
+}
+
+void
+txtelite_save(const txtelite *t, void *buf) {
+    savesnapshot(t, (snapshottype *)buf);
+}
+
+int
+txtelite_restore(txtelite *t, const void *buf) {
+    return loadsnapshot(t, (const snapshottype *)buf) ? TXTELITE_OK : TXTELITE_BADSNAPSHOT;
+}
+
+#define exportalign (8) /* Of each column in an export */
+
+static unsigned int
+colwidth(unsigned int type) /* Bytes per value */
+{
+    return (type == TXTELITE_STRING) ? (unsigned int)sizeof(unsigned int) : type;
+}
+
+static const txtelite_column *
+exportfind(const txtelite_export *x, const char *name, unsigned int type) /* Column name, of type if not 0 */
+{
+    unsigned int i;
+
+    if (strlen(name) >= sizeof(x->column->name))
+        return NULL;
+
+    for (i = 0; i < x->head->columns; i++) {
+        const txtelite_column *c = &x->column[i];
+
+        if ((0 == strncmp(c->name, name, sizeof(c->name))) && ((type == 0) || (c->type == type)))
+            return c;
+    }
+
+    return NULL;
+}
+
+int
+txtelite_export_open(txtelite_export *x, const void *data, size_t size)
+/*
+ * Every column must lie within the export, and every
+ * string within the heap and terminated, so readers
+ * need check nothing more
+ */
+{
+    const txtelite_export_head *head = (const txtelite_export_head *)data;
+    const txtelite_column *heap;
+    unsigned int i, k;
+
+    if ((size < sizeof(*head)) || (head->magic != TXTELITE_EXPORT_MAGIC) || (head->size > size)
+        || (head->size < sizeof(*head))
+        || (head->columns > (head->size - sizeof(*head)) / sizeof(txtelite_column)))
+        return TXTELITE_BADEXPORT;
+
+    x->base   = (const unsigned char *)data;
+    x->head   = head;
+    x->column = (const txtelite_column *)(head + 1);
+
+    for (i = 0; i < head->columns; i++) {
+        const txtelite_column *c = &x->column[i];
+        unsigned int width       = colwidth(c->type);
+
+        if (((c->type != TXTELITE_U8) && (c->type != TXTELITE_U16) && (c->type != TXTELITE_U32)
+             && (c->type != TXTELITE_STRING))
+            || (c->offset % exportalign) || (c->offset > head->size) || (c->count > (head->size - c->offset) / width))
+            return TXTELITE_BADEXPORT;
+    }
+
+    heap = exportfind(x, "heap", TXTELITE_U8);
+    for (i = 0; i < head->columns; i++) {
+        const txtelite_column *c = &x->column[i];
+        const unsigned int *off  = (const unsigned int *)(x->base + c->offset);
+
+        if (c->type != TXTELITE_STRING)
+            continue;
+
+        if ((heap == NULL) || (c->count == 0) || (off[0] > heap->count))
+            return TXTELITE_BADEXPORT;
+
+        for (k = 1; k < c->count; k++)
+            if ((off[k] <= off[k - 1]) || (off[k] > heap->count) || (x->base[heap->offset + off[k] - 1] != '\0'))
+                return TXTELITE_BADEXPORT;
+    }
+
+    return TXTELITE_OK;
+}
+
+const void *
+txtelite_export_column(const txtelite_export *x, const char *name, unsigned int *type, unsigned int *count) {
+    const txtelite_column *c = exportfind(x, name, 0);
+
+    if (c == NULL)
+        return NULL;
+
+    if (type != NULL)
+        *type = c->type;
+
+    if (count != NULL)
+        *count = c->count;
+
+    return x->base + c->offset;
+}
+
+const char *
+txtelite_export_string(const txtelite_export *x, const char *name, unsigned int row, size_t *len) {
+    const txtelite_column *c    = exportfind(x, name, TXTELITE_STRING);
+    const txtelite_column *heap = exportfind(x, "heap", TXTELITE_U8);
+    const unsigned int *off;
+
+    if ((c == NULL) || (heap == NULL) || (row >= c->count - 1))
+        return NULL;
+
+    off = (const unsigned int *)(x->base + c->offset);
+    if (len != NULL)
+        *len = off[row + 1] - off[row] - 1;
+
+    return (const char *)x->base + heap->offset + off[row];
+}
+
+unsigned int
+txtelite_random(txtelite *t) {
+    return (unsigned int)myrand(t);
+}
+
+void
+txtelite_random_bytes(txtelite *t, unsigned char *buf, size_t n) {
+    size_t i;
+
+    t->draws += n;
+    if (!t->nativerand) {
+        rngbytes(&t->rng, buf, n);
+    } else {
+        t->nativedraws += n;
+        for (i = 0; i < n; i++) buf[i] = (unsigned char)rand();
+    }
+}
+
+void
+txtelite_random_skip(txtelite *t, unsigned long n) {
+    if (!t->nativerand) {
+        t->draws += n;
+        rngskip(&t->rng, n);
+    }
+}
+
+int
+txtelite_policy_random(txtelite *t, void *arg) {
+    (void)arg;
+
+    return policyrandom(t);
+}
+
+int
+txtelite_policy_greedy(txtelite *t, void *arg) {
+    (void)arg;
+
+    return policygreedy(t);
+}
+
+int
+txtelite_simulate(const txtelite_universe *u, int commanders, int jumps, txtelite_policy policy, void *arg,
+                  unsigned long seed, long *profits, unsigned int *made) {
+    simjob job;
+
+    if (commanders <= 0)
+        return TXTELITE_OK;
+
+    job.u       = u;
+    job.stride  = rngperiod / (unsigned long)commanders;
+    job.jumps   = jumps;
+    job.policy  = policy;
+    job.arg     = arg;
+    job.seed    = seed;
+    job.profits = profits;
+    job.made    = made;
+    runparallel(simtask, &job, commanders);
+
+    return TXTELITE_OK;
+}
+
+void
+txtelite_threads(int n) {
+    numthreads = n;
+}
+
+#ifdef TXTELITE_GENERATOR
+
+/** Universe table generator **/
+
+/*
+ * Built as mkuniverse, which writes every system of every
+ * galaxy as C source for builds with TXTELITE_PREBUILT
+ */
+
+static void
+genarray(const char *field, const uint8 *a8, const uint16 *a16) /* One column of a galaxy */
+{
+    planetnum i;
+
+    (void)printf("        { /* %s */", field);
+    for (i = 0; i < galsize; ++i)
+        (void)printf("%s%u,", (i % 16) ? " " : "\n            ", a8 ? (unsigned int)a8[i] : (unsigned int)a16[i]);
+    (void)printf("\n        },\n");
+}
+
+int
+main(void) {
+    static galaxytype galaxies[numgalaxies];
+    int galcount;
+    planetnum i;
+
+    buildgalaxies(galaxies);
+
+    (void)printf("/* universe.h: generated by mkuniverse from txtelite.c; do not edit */\n\n");
+    (void)printf("static const galaxytype prebuiltgalaxies[numgalaxies] = {\n");
+    for (galcount = 0; galcount < numgalaxies; ++galcount) {
+        const galaxytype *g = &galaxies[galcount];
+
+        (void)printf("    { /* Galaxy %d */\n", galcount + 1);
+        genarray("x", g->x, NULL);
+        genarray("y", g->y, NULL);
+        genarray("economy", g->economy, NULL);
+        genarray("govtype", g->govtype, NULL);
+        genarray("techlev", g->techlev, NULL);
+        genarray("population", g->population, NULL);
+        genarray("productivity", NULL, g->productivity);
+        genarray("radius", NULL, g->radius);
+        genarray("human_colony", g->human_colony, NULL);
+        genarray("species_type", g->species_type, NULL);
+        genarray("species_adj1", g->species_adj1, NULL);
+        genarray("species_adj2", g->species_adj2, NULL);
+        genarray("species_adj3", g->species_adj3, NULL);
+
+        (void)printf("        { /* goatsoupseed */\n");
+        for (i = 0; i < galsize; ++i) {
+            const fastseedtype *f = &g->goatsoupseed[i];
+
+            (void)printf("            {0x%02X, 0x%02X, 0x%02X, 0x%02X},\n", f->a, f->b, f->c, f->d);
+        }
+        (void)printf("        },\n");
+
+        (void)printf("        { /* name */\n");
+        for (i = 0; i < galsize; ++i) (void)printf("            \"%s\",\n", g->name[i]);
+        (void)printf("        },\n");
+
+        (void)printf("    },\n");
+    }
+    (void)printf("};\n");
+
+    return ferror(stdout) ? 1 : 0;
+}
+
+#endif /* ifdef TXTELITE_GENERATOR */
+
+#ifndef TXTELITE_LIBRARY
+
+/** Required data for text interface **/
+
+/*
+ * Tradegood names used in text commands
+ * Set using commodities array
+ */
+
+static char tradnames[lasttrade][maxlen];
+
+#define nocomms (23)
+
+typedef struct {
+    const char *s;
+    size_t len;
+} wordtype; /* One word of a command, in place */
+
+/*
+ * A command parsed once, to be obeyed any number of times.
+ * A planet name is resolved for every galaxy in which it
+ * matches at most one system; otherwise, or if it was not
+ * resolved, it is matched when obeyed, as the nearest
+ * match depends on where the commander is.
+ */
+
+#define opempty   (nocomms)     /* Blank line */
+#define opbad     (nocomms + 1) /* Unknown command, in word[0] */
+#define opaborted (nocomms + 2) /* Line held a backspace */
+
+#define nowhere  (-1) /* No system matches: the current one */
+#define anywhere (-2) /* Match by name when obeyed */
+
+typedef struct {
+    uint8 command;    /* Index into commands, or an op above */
+    uint8 good;       /* Trade good, lasttrade if unknown */
+    uint8 given;      /* Optional arguments present, by bit */
+    int32 num[3];     /* Numeric arguments */
+    wordtype word[2]; /* Planet names */
+    int16 planet[2][numgalaxies];
+} optype;
+
+static void parsenone   (const char *, optype *);
+static void parsetrade  (const char *, optype *);
+static void parsefuel   (const char *, optype *);
+static void parseplanet (const char *, optype *);
+static void parsecash   (const char *, optype *);
+static void parsehold   (const char *, optype *);
+static void parsenear   (const char *, optype *);
+static void parsewithin (const char *, optype *);
+static void parseroute  (const char *, optype *);
+static void parsereach  (const char *, optype *);
+static void parseplan   (const char *, optype *);
+static void parsearb    (const char *, optype *);
+static void parsefile   (const char *, optype *);
+
+static boolean dobuy       (contexttype *, const optype *);
+static boolean dosell      (contexttype *, const optype *);
+static boolean dofuel      (contexttype *, const optype *);
+static boolean dojump      (contexttype *, const optype *);
+static boolean docash      (contexttype *, const optype *);
+static boolean domkt       (contexttype *, const optype *);
+static boolean dohelp      (contexttype *, const optype *);
+static boolean dohold      (contexttype *, const optype *);
+static boolean dosneak     (contexttype *, const optype *);
+static boolean dolocal     (contexttype *, const optype *);
+static boolean doinfo      (contexttype *, const optype *);
+static boolean dogalhyp    (contexttype *, const optype *);
+static boolean doquit      (contexttype *, const optype *);
+static boolean dotweakrand (contexttype *, const optype *);
+static boolean donear      (contexttype *, const optype *);
+static boolean dowithin    (contexttype *, const optype *);
+static boolean doroute     (contexttype *, const optype *);
+static boolean doreach     (contexttype *, const optype *);
+static boolean doplan      (contexttype *, const optype *);
+static boolean dobestbuy   (contexttype *, const optype *);
+static boolean doarb       (contexttype *, const optype *);
+static boolean dosave      (contexttype *, const optype *);
+static boolean doload      (contexttype *, const optype *);
+
+static boolean journalobey (contexttype *, const char *, const optype *);
+static int     checkjournal(const universetype *);
+
+static char commands[nocomms][maxlen] = {"buy",    "sell", "fuel",  "jump",  "cash", "mkt",     "help",
+                                         "hold",   "sneak", "local", "info",  "galhyp", "quit",   "rand",
+                                         "near",   "within", "route", "reach", "plan",  "bestbuy", "arb",
+                                         "save",   "load"};
+
+static void (*const comparse[nocomms])(const char *, optype *) = {
+    parsetrade, parsetrade, parsefuel,   parseplanet, parsecash,  parsenone,   parsenone,
+    parsehold,  parseplanet, parsenone,  parseplanet, parsenone,  parsenone,   parsenone,
+    parsenear,  parsewithin, parseroute, parsereach,  parseplan,  parseplanet, parsearb,
+    parsefile,  parsefile};
+
+static boolean (*const comfuncs[nocomms])(contexttype *, const optype *) = {
+    dobuy,  dosell,  dofuel,   dojump,  docash, domkt,     dohelp,
+    dohold, dosneak, dolocal,  doinfo,  dogalhyp, doquit,  dotweakrand,
+    donear, dowithin, doroute, doreach, doplan,   dobestbuy, doarb,
+    dosave, doload};
+
+#define quitcommand (12) /* Index of "quit" */
+#define loadcommand (22) /* Index of "load" */
+
+/** Output sinks **/
+
+/*
+ * All text interface output goes through one sink.  The
+ * buffered sink collects output and writes it in one go
+ * when full and before each command is read, with large
+ * pieces passed straight through.  The null sink drops
+ * output without formatting it, for headless runs.
+ */
+
+#define outsize (0x10000)
+#define outline (512) /* Longest output of one outf */
+
+#define nosinks (2)
+
+static const char sinknames[nosinks][maxlen] = {"buffered", "null"};
+
+typedef struct {
+    boolean discard; /* Null sink */
+    size_t len;
+    char buf[outsize];
+} sinktype;
+
+static sinktype sink;
+
+static void
+outwrite(const char *a, size_t alen, const char *b, size_t blen) /* a then b to stdout, in one writev if we can */
+{
+#ifdef TXTELITE_WRITEV
+    struct iovec iov[2];
+    int first = 0;
+
+    iov[0].iov_base = (void *)a;
+    iov[0].iov_len  = alen;
+    iov[1].iov_base = (void *)b;
+    iov[1].iov_len  = blen;
+    while (first < 2) {
+        ssize_t n = writev(STDOUT_FILENO, iov + first, 2 - first);
+
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return;
+        }
+
+        while ((first < 2) && ((size_t)n >= iov[first].iov_len)) {
+            n -= (ssize_t)iov[first].iov_len;
+            first++;
+        }
+
+        if (first < 2) {
+            iov[first].iov_base = (char *)iov[first].iov_base + n;
+            iov[first].iov_len -= (size_t)n;
+        }
+    }
+#else
+    if (alen > 0)
+        (void)fwrite(a, 1, alen, stdout);
+
+    if (blen > 0)
+        (void)fwrite(b, 1, blen, stdout);
+
+    (void)fflush(stdout);
+#endif /* ifdef TXTELITE_WRITEV */
+}
+
+static void
+outflush(void) {
+    if (sink.len > 0)
+        outwrite(sink.buf, sink.len, NULL, 0);
+
+    sink.len = 0;
+}
+
+static void
+outn(const char *s, size_t n) /* n bytes of s */
+{
+    if (sink.discard)
+        return;
+
+    if (n > outsize - sink.len) {
+        outwrite(sink.buf, sink.len, s, n);
+        sink.len = 0;
+    } else {
+        (void)memcpy(sink.buf + sink.len, s, n);
+        sink.len += n;
+    }
+}
+
+static void
+outs(const char *s) {
+    if (!sink.discard)
+        outn(s, strlen(s));
+}
+
+static void
+outf(const char *fmt, ...) /* As printf, for at most outline bytes */
+{
+    va_list ap;
+    int n;
+
+    if (sink.discard)
+        return;
+
+    if (outsize - sink.len < outline)
+        outflush();
+
+    va_start(ap, fmt);
+    n = vsprintf(sink.buf + sink.len, fmt, ap);
+    va_end(ap);
+
+    if (n > 0)
+        sink.len += (size_t)n;
+}
+
+static void
+outtenths(long v, int width, boolean plus)
+/*
+ * Tenths as printf("%*.1f") of v/10 would show them,
+ * or "%+*.1f" if plus, without going through floating
+ * point
+ */
+{
+    char s[32];
+    int i = (int)sizeof(s);
+    unsigned long u = (v < 0) ? 0UL - (unsigned long)v : (unsigned long)v;
+
+    if (sink.discard)
+        return;
+
+    s[--i] = (char)('0' + u % 10);
+    s[--i] = '.';
+    u /= 10;
+    do {
+        s[--i] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u > 0);
+
+    if (v < 0)
+        s[--i] = '-';
+    else if (plus)
+        s[--i] = '+';
+
+    while ((i > 0) && ((int)sizeof(s) - i < width)) s[--i] = ' ';
+
+    outn(s + i, sizeof(s) - (size_t)i);
+}
+
+/** String functions for text interface **/
+
+/*
+ * Abbreviation tries.  A word matches the first key it
+ * begins, ignoring case, so each node keeps the lowest
+ * key index below it and a lookup costs one step per
+ * character.  Characters are mapped to the few classes
+ * that occur in keys; class 0 is any other character.
+ */
+
+#define trienodes   (256)
+#define trieclasses (40)
+
+typedef struct {
+    uint8 cls[256];
+    int nclasses;
+    int nnodes;
+    uint8 first[trienodes];               /* Lowest key index with this prefix */
+    uint16 next[trienodes][trieclasses]; /* Child nodes, 0 for none */
+} trietype;
+
+static trietype commandtrie, tradetrie;
+
+static void
+buildtrie(trietype *trie, char a[][maxlen], myuint n) /* Keys a[0] to a[n-1] */
+{
+    myuint i;
+
+    (void)memset(trie, 0, sizeof(*trie));
+    trie->nclasses = 1;
+    trie->nnodes   = 1;
+    for (i = n; i-- > 0;) { /* Last key first, so lower ones overwrite */
+        const char *k = a[i];
+        int node      = 0;
+
+        trie->first[0] = (uint8)i;
+        for (; *k != '\0'; k++) {
+            int c = tolower((unsigned char)*k);
+
+            if (trie->cls[c] == 0) {
+                if (trie->nclasses == trieclasses)
+                    break;
+
+                trie->cls[c] = (uint8)(trie->nclasses++);
+            }
+
+            if (trie->next[node][trie->cls[c]] == 0) {
+                if (trie->nnodes == trienodes)
+                    break;
+
+                trie->next[node][trie->cls[c]] = (uint16)(trie->nnodes++);
+            }
+
+            node              = trie->next[node][trie->cls[c]];
+            trie->first[node] = (uint8)i;
+        }
+    }
+}
+
+static myuint
+triematch(const trietype *trie, const char *s, size_t len)
+/*
+ * Check the len characters at s against the keys
+ * If they begin key i (first such) return i+1 else return 0
+ */
+{
+    int node = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        node = trie->next[node][trie->cls[(unsigned char)tolower((unsigned char)s[i])]];
+        if (node == 0)
+            return 0;
+    }
+
+    return (myuint)(trie->first[node] + 1);
+}
+
+static const char *
+splitword(const char *s, wordtype *w)
+/*
+ * Find the first 'word' of s, after any leading
+ * spaces, and return the rest of s past the one
+ * space that ends it; nothing is copied
+ */
+{
+    while (*s == ' ') s++;
+
+    w->s = s;
+    while ((*s != '\0') && (*s != ' ')) s++;
+    w->len = (size_t)(s - w->s);
+
+    return (*s == ' ') ? s + 1 : s;
+}
+
+/** Print data for markets and systems **/
+
+static void
+displaymarket(const contexttype *ctx, markettype m) {
+    unsigned short i;
+
+    outs("Item         \t  Price\t   Quantity  \tHold\n"
+         "=============\t ======\t  ========== \t====\n");
+    for (i = 0; i <= lasttrade; i++) {
+        outf("\n%s\t ", commodities[i].name);
+        outtenths((long)m.price[i], 6, false);
+        outf("\t %6u%s\t %2u", m.quantity[i], unitnames[commodities[i].units], ctx->shipshold[i]);
+    }
+}
+
+static void
+prisys(const contexttype *ctx, planetnum i, boolean compressed) {
+    const galaxytype *g = ctx->galaxy;
+    char desc[desclen];
+
+    if (compressed) {
+        outf("%10s TL: %2i %12s %15s", g->name[i], (g->techlev[i]) + 1, econnames[g->economy[i]],
+             govnames[g->govtype[i]]);
+    } else {
+        plansys plsy = unpacksystem(g, i);
+        const char *text;
+        size_t len;
+
+        outf("System  \t: %s", plsy.name);
+        outf("\nPosition  \t: (%i,%i)", plsy.x, plsy.y);
+        outf("\nEconomy   \t: (%i) %s", plsy.economy, econnames[plsy.economy]);
+        outf("\nGovernment\t: (%i) %s", plsy.govtype, govnames[plsy.govtype]);
+        outf("\nTech Level\t: %-2i", (plsy.techlev) + 1);
+        outf("\nTurnover  \t: %u", (plsy.productivity));
+        outf("\nRadius    \t: %u", plsy.radius);
+        outs("\nPopulation\t: ");
+        outtenths((long)plsy.population, 0, false);
+        outs(" Billion\nSpecies   \t: ");
+        (void)describespecies(g, i, desc, sizeof(desc));
+        outs(desc);
+        outs("\n\n");
+
+        text = cacheddesc(ctx, i, &len);
+        if (text != NULL) {
+            outn(text, len);
+        } else {
+            (void)describesys(&ctx->universe->soup, g, i, desc, sizeof(desc));
+            outs(desc);
+        }
+    }
+}
+
+/** Command parsing **/
+
+static void
+parsenone(const char *s, optype *op) {
+    (void)s;
+    (void)op;
+}
+
+static void
+parsetrade(const char *s, optype *op)
+/*
+ * Good s(1), amount s(2), 1 if none
+ */
+{
+    wordtype w1;
+    myuint i, a;
+
+    s = splitword(s, &w1);
+    a = (myuint)atoi(s);
+    if (a == 0)
+        a = 1;
+
+    i = triematch(&tradetrie, w1.s, w1.len);
+
+    op->good   = (uint8)(i ? i - 1 : lasttrade);
+    op->num[0] = (int32)a;
+}
+
+static void
+parsefuel(const char *s, optype *op) {
+    op->num[0] = (int32)(myuint)(double)floor(10 * atof(s));
+}
+
+static void
+parseplanet(const char *s, optype *op) /* Planet s, if given */
+{
+    op->word[0].s   = s;
+    op->word[0].len = strlen(s);
+    op->given       = (s[0] != 0);
+}
+
+static void
+parsecash(const char *s, optype *op) {
+    op->num[0] = (int)(10 * atof(s));
+}
+
+static void
+parsehold(const char *s, optype *op) {
+    op->num[0] = (int32)(myuint)atoi(s);
+}
+
+static void
+parsenear(const char *s, optype *op)
+/*
+ * Position s(1),s(2), count s(3)
+ */
+{
+    wordtype wx, wy;
+    int k;
+
+    s = splitword(s, &wx);
+    s = splitword(s, &wy);
+    if ((wx.len == 0) || (wy.len == 0))
+        return;
+
+    k = atoi(s);
+    if (k <= 0)
+        k = 1;
+
+    op->given  = 1;
+    op->num[0] = clampmap(strtol(wx.s, NULL, 10));
+    op->num[1] = clampmap(strtol(wy.s, NULL, 10));
+    op->num[2] = k;
+}
+
+static void
+parsewithin(const char *s, optype *op)
+/*
+ * Planet s(1), range s(2)
+ */
+{
+    s          = splitword(s, &op->word[0]);
+    op->num[0] = (int32)(myuint)(double)floor(10 * atof(s));
+}
+
+static void
+parseroute(const char *s, optype *op)
+/*
+ * Planets s(1) and s(2), kind s(3)
+ */
+{
+    s = splitword(s, &op->word[0]);
+    s = splitword(s, &op->word[1]);
+    if ((op->word[0].len == 0) || (op->word[1].len == 0))
+        return;
+
+    op->given  = 1;
+    op->num[0] = ((s[0] != 0) && stringbeg(s, strlen(s), "fuel")) ? fuelroute : hopsroute;
+}
+
+static void
+parsereach(const char *s, optype *op)
+/*
+ * Planet s(1), and planet s(2) if given
+ */
+{
+    s = splitword(s, &op->word[0]);
+    if (s[0] != 0) {
+        op->given       = 1;
+        op->word[1].s   = s;
+        op->word[1].len = strlen(s);
+    }
+}
+
+static void
+parseplan(const char *s, optype *op)
+/*
+ * Jumps s(1), cash s(2) and hold s(3) if given
+ */
+{
+    wordtype w1, w2;
+
+    s          = splitword(s, &w1);
+    s          = splitword(s, &w2);
+    op->num[0] = atoi(w1.s);
+    if (w2.len) {
+        op->given |= 1;
+        op->num[1] = (int32)(10 * atof(w2.s));
+    }
+
+    if (s[0]) {
+        op->given |= 2;
+        op->num[2] = (int32)(myuint)atoi(s);
+    }
+}
+
+static void
+parsearb(const char *s, optype *op) {
+    parseplanet(s, op);
+}
+
+static void
+parsefile(const char *s, optype *op)
+/*
+ * File s(1), snapshot number s(2) if given
+ */
+{
+    s          = splitword(s, &op->word[0]);
+    op->given  = (s[0] != 0);
+    op->num[0] = atoi(s);
+}
+
+static void
+parseline(const char *s, optype *op)
+/*
+ * Parse command s; op refers to s for names
+ */
+{
+    myuint i;
+    wordtype c;
+    int k, galcount;
+
+    (void)memset(op, 0, sizeof(*op));
+    for (k = 0; k < 2; k++)
+        for (galcount = 0; galcount < numgalaxies; galcount++) op->planet[k][galcount] = anywhere;
+
+    if (s[0] == '\0') {
+        op->command = opempty;
+
+        return;
+    }
+
+    s = splitword(s, &c);
+    i = triematch(&commandtrie, c.s, c.len);
+    if (i == 0) {
+        op->command = opbad;
+        op->word[0] = c;
+
+        return;
+    }
+
+    op->command = (uint8)(i - 1);
+    (*comparse[i - 1])(s, op);
+}
+
+static void
+resolveop(const universetype *u, optype *op)
+/*
+ * Resolve op's planet names in every galaxy where
+ * that does not depend on the current planet
+ */
+{
+    int k, galcount;
+
+    if ((op->command >= nocomms) || (comparse[op->command] == parsefile))
+        return;
+
+    for (k = 0; k < 2; k++) {
+        const wordtype *w = &op->word[k];
+
+        if (w->s == NULL)
+            continue;
+
+        for (galcount = 0; galcount < numgalaxies; galcount++) {
+            const galaxytype *g = &u->galaxies[galcount];
+            int found = 0, p = nowhere;
+            planetnum i;
+
+            for (i = 0; (i < galsize) && (found < 2); i++)
+                if (stringbeg(w->s, w->len, g->name[i])) {
+                    found++;
+                    p = i;
+                }
+
+            op->planet[k][galcount] = (int16)((found < 2) ? p : anywhere);
+        }
+    }
+}
+
+static planetnum
+opplanet(const contexttype *ctx, const optype *op, int k) /* Planet named by word k */
+{
+    int p = op->planet[k][ctx->galaxynum - 1];
+
+    if (p == anywhere)
+        return matchsys(ctx, op->word[k].s, op->word[k].len);
+
+    return (p == nowhere) ? ctx->currentplanet : p;
+}
+
+/** Various command functions **/
+
+static boolean
+dotweakrand(contexttype *ctx, const optype *op) {
+    (void)op;
+    ctx->nativerand ^= 1;
+    outs(ctx->nativerand ? "Now using native randomization." : "Now using weak randomization.");
+
+    return true;
+}
+
+static void
+prilocal(const contexttype *ctx, planetnum i, myuint d) {
+    if (d <= ctx->fuel)
+        outs("\n * ");
+    else
+        outs("\n - ");
+
+    prisys(ctx, i, true);
+    outs(" (");
+    outtenths((long)d, 0, false);
+    outs(" LY)");
+}
+
+static boolean
+dolocal(contexttype *ctx, const optype *op)
+/*
+ * List systems in jump range, here included,
+ * straight from the jump graph
+ */
+{
+    const graphtype *graph = ctx->graph;
+    planetnum here         = ctx->currentplanet;
+    boolean shown          = false;
+    int e;
+
+    (void)op;
+    outf("Galaxy number %i:", ctx->galaxynum);
+    for (e = graph->start[here]; e < graph->start[here + 1]; e++) {
+        if (!shown && (graph->adj[e] > here)) {
+            prilocal(ctx, here, 0);
+            shown = true;
+        }
+
+        prilocal(ctx, graph->adj[e], graph->dist[e]);
+    }
+
+    if (!shown)
+        prilocal(ctx, here, 0);
+
+    return true;
+}
+
+static void
+prifound(const contexttype *ctx, const planetnum *found, const myuint *dist, int n) {
+    int i;
+
+    for (i = 0; i < n; i++) {
+        outs("\n ");
+        prisys(ctx, found[i], true);
+        outs(" (");
+        outtenths((long)dist[i], 0, false);
+        outs(" LY)");
+    }
+}
+
+static boolean
+donear(contexttype *ctx, const optype *op)
+/*
+ * List the s(3) systems nearest map position s(1),s(2)
+ */
+{
+    planetnum found[galsize];
+    myuint dist[galsize];
+
+    if (!op->given) {
+        outs("Give a position, e.g. 'near 20 173'");
+
+        return false;
+    }
+
+    outf("Galaxy number %i:", ctx->galaxynum);
+    prifound(ctx, found, dist,
+             gridnearest(ctx->galaxy, ctx->grid, (int)op->num[0], (int)op->num[1], (int)op->num[2], found, dist));
+
+    return true;
+}
+
+static boolean
+doroute(contexttype *ctx, const optype *op)
+/*
+ * Route from planet s(1) to planet s(2), by
+ * fewest jumps or, if s(3) is "fuel", least fuel
+ */
+{
+    planetnum path[galsize], from, to;
+    int kind = (int)op->num[0], n, i;
+    myuint total = 0;
+
+    if (!op->given) {
+        outs("Give two planets, e.g. 'route lave diso'");
+
+        return false;
+    }
+
+    from = opplanet(ctx, op, 0);
+    to   = opplanet(ctx, op, 1);
+
+    n = findroute(ctx, from, to, kind, path);
+    if (n == 0) {
+        outf("No route from %s to %s", ctx->galaxy->name[from], ctx->galaxy->name[to]);
+
+        return false;
+    }
+
+    outf("Route from %s to %s (%s):", ctx->galaxy->name[from], ctx->galaxy->name[to],
+         kind == hopsroute ? "fewest jumps" : "least fuel");
+    for (i = 0; i < n; i++) {
+        myuint d = i ? distance(ctx->galaxy, path[i - 1], path[i]) : 0;
+
+        total += d;
+        outf("\n %3d ", i);
+        prisys(ctx, path[i], true);
+        outs(" (");
+        outtenths((long)d, 0, false);
+        outs(" LY)");
+    }
+
+    outf("\n %d jumps, ", n - 1);
+    outtenths((long)total, 0, false);
+    outs(" LY");
+
+    return true;
+}
+
+static void
+pricargo(const cargotype *cargo) /* As "Buy 3t Food, 2kg Gold" */
+{
+    const char *sep = "Buy ";
+    myuint i;
+
+    for (i = 0; i <= lasttrade; i++)
+        if (cargo->amount[i] > 0) {
+            const char *name = commodities[i].name;
+            int len          = (int)strlen(name);
+
+            while ((len > 0) && (name[len - 1] == ' ')) len--;
+
+            outf("%s%u%s %.*s", sep, cargo->amount[i], unitnames[commodities[i].units], len, name);
+            sep = ", ";
+        }
+
+    if (sep[0] == 'B')
+        outs("Buy nothing");
+}
+
+static boolean
+doplan(contexttype *ctx, const optype *op)
+/*
+ * Plan s(1) jumps of trading from here, with cash
+ * s(2) and hold space s(3) if given
+ */
+{
+    int hops = (int)op->num[0], width, jumps, level;
+    int32 cash;
+    myuint hold;
+    plannode best, node;
+
+    if ((hops <= 0) || (hops > maxplanhops)) {
+        outf("Give a number of jumps from 1 to %i", maxplanhops);
+
+        return false;
+    }
+
+    cash = (op->given & 1) ? op->num[1] : ctx->cash;
+    hold = (op->given & 2) ? (myuint)op->num[2] : ctx->holdspace;
+
+    jumps = plantrade(ctx, hops, cash, hold, planbudget, &best, &width);
+    if (jumps == 0) {
+        outf("No trading run from %s", ctx->galaxy->name[ctx->currentplanet]);
+
+        return false;
+    }
+
+    outf("Galaxy number %i, from %s with ", ctx->galaxynum, ctx->galaxy->name[ctx->currentplanet]);
+    outtenths((long)cash, 0, false);
+    outf(" CR and %ut free:", hold);
+
+    /* Replay the plan to show the trades */
+    (void)memset(&node, 0, sizeof(node));
+    node.cash    = cash;
+    node.fuel    = ctx->fuel;
+    node.path[0] = best.path[0];
+    for (level = 0; level < jumps; level++) {
+        planetnum here = best.path[level], to = best.path[level + 1];
+        myuint d       = distance(ctx->galaxy, here, to);
+        cargotype cargo;
+        plannode after;
+
+        (void)planstep(ctx, hold, &node, level, to, d, &after, &cargo);
+        outs("\n ");
+        if (node.fuel < d) {
+            outs("Fuel ");
+            outtenths((long)(d - node.fuel), 0, false);
+            outs("LY, ");
+        }
+        pricargo(&cargo);
+        outf("\n %2i ", level + 1);
+        prisys(ctx, to, true);
+        outs(" (");
+        outtenths((long)d, 0, false);
+        outs(" LY) ");
+        outtenths((long)after.cash, 0, false);
+        outs(" CR");
+        node = after;
+    }
+
+    outs("\n Estimated profit ");
+    outtenths((long)(best.cash - cash), 0, false);
+    outf(" CR (beam width %i)", width);
+
+    return true;
+}
+
+static boolean
+dobestbuy(contexttype *ctx, const optype *op)
+/*
+ * Buy the most profitable cargo to sell
+ * at planet s, at a typical market there
+ */
+{
+    planetnum dest = opplanet(ctx, op, 0);
+    cargotype cargo;
+    int32 profit;
+    myuint i;
+
+    profit = choosecargo(&ctx->localmarket, &ctx->universe->markets.typical[ctx->galaxy->economy[dest]], ctx->cash,
+                         ctx->holdspace, &cargo);
+    if (profit == 0) {
+        outf("Nothing here sells at a profit at %s", ctx->galaxy->name[dest]);
+
+        return false;
+    }
+
+    for (i = 0; i <= lasttrade; i++)
+        if (cargo.amount[i] > 0)
+            (void)gamebuy(ctx, i, cargo.amount[i]);
+
+    outf("For %s: ", ctx->galaxy->name[dest]);
+    pricargo(&cargo);
+    outs("\n Estimated profit ");
+    outtenths((long)profit, 0, false);
+    outs(" CR");
+
+    return true;
+}
+
+static boolean
+doarb(contexttype *ctx, const optype *op)
+/*
+ * Best single good to carry from planet s (or
+ * here) to each system in range, best first
+ */
+{
+    const arbtype *arb = getarbs(ctx);
+    planetnum from     = op->given ? opplanet(ctx, op, 0) : ctx->currentplanet;
+    planetnum order[galsize];
+    int n = 0, i, j;
+
+    if (arb == NULL) {
+        outs("Out of memory");
+
+        return false;
+    }
+
+    for (i = 0; i < galsize; i++)
+        if (arb->profit[from][i] > 0) {
+            for (j = n; (j > 0) && (arb->profit[from][order[j - 1]] < arb->profit[from][i]); j--) order[j] = order[j - 1];
+            order[j] = i;
+            n++;
+        }
+
+    outf("From %s, per tonne at typical markets:", ctx->galaxy->name[from]);
+    for (j = 0; j < n; j++) {
+        const char *name = commodities[arb->good[from][order[j]]].name;
+        int len          = (int)strlen(name);
+
+        while ((len > 0) && (name[len - 1] == ' ')) len--;
+
+        outs("\n ");
+        prisys(ctx, order[j], true);
+        outs(" ");
+        outtenths((long)arb->profit[from][order[j]], 6, true);
+        outs(" CR ");
+        outn(name, (size_t)len);
+    }
+
+    if (n == 0)
+        outs("\n Nothing in range sells at a profit");
+
+    return true;
+}
+
+static boolean
+doreach(contexttype *ctx, const optype *op)
+/*
+ * Size of planet s(1)'s component of the jump graph,
+ * and whether planet s(2), if given, is in it
+ */
+{
+    const graphtype *graph = ctx->graph;
+    const galaxytype *g    = ctx->galaxy;
+    planetnum a = opplanet(ctx, op, 0), b;
+
+    outf("%s can reach %i of %i systems with a ", g->name[a], graph->compsize[graph->comp[a]] - 1, galsize - 1);
+    outtenths((long)ctx->universe->graphrange, 0, false);
+    outs(" LY drive");
+
+    if (op->given) {
+        b = opplanet(ctx, op, 1);
+        outf("\n %s %s reachable from %s", g->name[b], graph->comp[a] == graph->comp[b] ? "is" : "is not",
+             g->name[a]);
+    }
+
+    return true;
+}
+
+static boolean
+dowithin(contexttype *ctx, const optype *op)
+/*
+ * List systems within s(2) LY of planet s(1)
+ */
+{
+    planetnum found[galsize], p = opplanet(ctx, op, 0);
+    myuint dist[galsize];
+
+    outf("Galaxy number %i:", ctx->galaxynum);
+    prifound(ctx, found, dist,
+             gridwithin(ctx->galaxy, ctx->grid, ctx->galaxy->x[p], ctx->galaxy->y[p],
+                        (myuint)op->num[0], found, dist));
+
+    return true;
+}
+
+static boolean
+prijump(const contexttype *ctx, int r) /* Report outcome of a jump */
+{
+    switch (r) {
+        case TXTELITE_OK: prisys(ctx, ctx->currentplanet, false); return true;
+        case TXTELITE_TOOFAR: outs("Jump to far"); return false;
+        default: outs("Bad jump"); return false;
+    }
+}
+
+static boolean
+dojump(contexttype *ctx, const optype *op)
+/*
+ * Jump to planet name s
+ */
+{
+    return prijump(ctx, gamehyperjump(ctx, opplanet(ctx, op, 0)));
+}
+
+static boolean
+dosneak(contexttype *ctx, const optype *op)
+/*
+ * As dojump but no fuel cost
+ */
+{
+    return prijump(ctx, gamesneak(ctx, opplanet(ctx, op, 0)));
+}
+
+static boolean
+dogalhyp(contexttype *ctx, const optype *op)
+/*
+ * Jump to next galaxy
+ */
+{
+    (void)(op); /* Discard op */
+
+    gamegalhyp(ctx);
+
+    outf("Jumped to galaxy %u", ctx->galaxynum);
+
+    return true;
+}
+
+static boolean
+doinfo(contexttype *ctx, const optype *op)
+/*
+ * Info on planet
+ */
+{
+    planetnum dest = opplanet(ctx, op, 0);
+
+    prisys(ctx, dest, false);
+
+    return true;
+}
+
+static boolean
+dohold(contexttype *ctx, const optype *op) {
+    if (!gamehold(ctx, (myuint)op->num[0])) {
+        outs("Hold too full");
+
+        return false;
+    }
+
+    return true;
+}
+
+static boolean
+dosell(contexttype *ctx, const optype *op)
+/*
+ * Sell amount s(2) of good s(1)
+ */
+{
+    myuint i = op->good, t;
+
+    if (i == lasttrade) {
+        outs("Unknown trade good");
+
+        return false;
+    }
+
+    t = gamesell(ctx, i, (myuint)op->num[0]);
+
+    if (t == 0) {
+        outs("Cannot sell any ");
+    } else {
+        outf("Selling %i%s of ", t, unitnames[commodities[i].units]);
+    }
+
+    outs(tradnames[i]);
+
+    return true;
+}
+
+static boolean
+dobuy(contexttype *ctx, const optype *op)
+/*
+ * Buy amount s(2) of good s(1)
+ */
+{
+    myuint i = op->good, t;
+
+    if (i == lasttrade) {
+        outs("Unknown trade good");
+
+        return false;
+    }
+
+    t = gamebuy(ctx, i, (myuint)op->num[0]);
+    if (t == 0) {
+        outs("Cannot buy any ");
+    } else {
+        outf("Buying %i%s of ", t, unitnames[commodities[i].units]);
+    }
+
+    outs(tradnames[i]);
+
+    return true;
+}
+
+static boolean
+dofuel(contexttype *ctx, const optype *op)
+/*
+ * Buy amount s of fuel
+ */
+{
+    myuint f = gamefuel(ctx, (myuint)op->num[0]);
+
+    if (f == 0) {
+        outs("Cannot buy any fuel");
+
+        return false;
+    }
+
+    outs("Buying ");
+    outtenths((long)f, 0, false);
+    outs("LY fuel");
+
+    return true;
+}
+
+static boolean
+docash(contexttype *ctx, const optype *op)
+/*
+ * Cheat alter cash by s
+ */
+{
+    int a = (int)op->num[0];
+
+    ctx->cash += (long)a;
+    if (a != 0)
+        return true;
+
+    outs("Number not understood");
+
+    return false;
+}
+
+static boolean
+domkt(contexttype *ctx, const optype *op)
+/*
+ * Show stock market
+ */
+{
+    (void)op;
+    displaymarket(ctx, ctx->localmarket);
+
+    return true;
+}
+
+static boolean seeking; /* Obeying a journal again: save writes nothing */
+
+static boolean
+opfile(const optype *op, char *name) /* File named by word 0, in maxlen bytes */
+{
+    size_t len = op->word[0].len;
+
+    if ((len == 0) || (len >= maxlen))
+        return false;
+
+    (void)memcpy(name, op->word[0].s, len);
+    name[len] = '\0';
+
+    return true;
+}
+
+static boolean
+dosave(contexttype *ctx, const optype *op)
+/*
+ * Append a snapshot to file s
+ */
+{
+    char name[maxlen];
+    snapshottype snap;
+    FILE *f;
+    boolean ok;
+
+    if (!opfile(op, name)) {
+        outs("No file name");
+
+        return false;
+    }
+
+    if (seeking) {
+        outf("Saved to %s", name); /* As it was the first time */
+
+        return true;
+    }
+
+    savesnapshot(ctx, &snap);
+    f  = fopen(name, "ab");
+    ok = (f != NULL) && (fwrite(&snap, sizeof(snap), 1, f) == 1);
+    if ((f != NULL) && (fclose(f) != 0))
+        ok = false;
+
+    if (!ok) {
+        outf("Cannot save to %s", name);
+
+        return false;
+    }
+
+    outf("Saved to %s", name);
+
+    return true;
+}
+
+static boolean
+doload(contexttype *ctx, const optype *op)
+/*
+ * Resume from snapshot s(2) of file s(1),
+ * counting from 0, or from its last
+ */
+{
+    char name[maxlen];
+    snapshottype snap;
+    FILE *f;
+    boolean ok;
+
+    if (!opfile(op, name)) {
+        outs("No file name");
+
+        return false;
+    }
+
+    f = fopen(name, "rb");
+    if (f == NULL) {
+        outf("Cannot open %s", name);
+
+        return false;
+    }
+
+    if (op->given)
+        ok = (op->num[0] >= 0) && (fseek(f, (long)op->num[0] * (long)sizeof(snap), SEEK_SET) == 0);
+    else
+        ok = (fseek(f, -(long)sizeof(snap), SEEK_END) == 0);
+
+    ok = ok && (fread(&snap, sizeof(snap), 1, f) == 1);
+    (void)fclose(f);
+
+    if (!ok || !loadsnapshot(ctx, &snap)) {
+        outf("No such snapshot in %s", name);
+
+        return false;
+    }
+
+    outf("Resumed at %s in galaxy %u", ctx->galaxy->name[ctx->currentplanet], ctx->galaxynum);
+
+    return true;
+}
+
+static boolean
+obey(contexttype *ctx, const optype *op)
+/*
+ * Obey parsed command op
+ */
+{
+    switch (op->command) {
+        case opempty: outs(" Error: Empty command"); return false;
+        case opbad: outf(" Error: Bad command (%.*s)", (int)op->word[0].len, op->word[0].s); return false;
+        case opaborted: outs(" Error: Aborted command"); return false;
+        default: return (*comfuncs[op->command])(ctx, op);
+    }
+}
+
+static boolean
+parser(contexttype *ctx, const char *s)
+/*
+ * Obey command s
+ */
+{
+    optype op;
+
+    parseline(s, &op);
+
+    return journalobey(ctx, s, &op);
+}
+
+static boolean
+doquit(contexttype *ctx, const optype *op) {
+    (void)(&op);
+    outs("\n\nQuit.\n");
+
+    ctx->quit = true;
+
+    return true;
+}
+
+boolean
+dohelp(contexttype *ctx, const optype *op) {
+    (void)ctx;
+    (void)(&op);
+    outs(" Commands are:");
+    outs("\n --------------------------------------------------------");
+    outs("\n [B]uy     <tradegood> <amount>");
+    outs("\n [S]ell    <tradegood> <amount>");
+    outs("\n [F]uel    <amount>  (buy amount LY of fuel)");
+    outs("\n --------------------------------------------------------");
+    outs("\n [J]ump    <planet>  (limited by fuel)");
+    outs("\n [G]alhyp            (jumps to next galaxy)");
+    outs("\n --------------------------------------------------------");
+    outs("\n [I]nfo    [planet]  (prints info on system)");
+    outs("\n [M]kt               (shows market prices)");
+    outs("\n [L]ocal             (lists systems within 7 light years)");
+    outs("\n [N]ear   <x> <y> [n] (lists n systems nearest a position)");
+    outs("\n [W]ithin <planet> <LY> (lists systems within range)");
+    outs("\n [Ro]ute  <from> <to> [fuel] (fewest jumps, or least fuel)");
+    outs("\n [Re]ach  [planet] [planet] (systems reachable from a system)");
+    outs("\n [P]lan   <jumps> [cash] [hold] (plans a trading run)");
+    outs("\n [Be]stbuy <planet> (buys the best cargo to sell there)");
+    outs("\n [A]rb    [planet]  (best good to carry to each system)");
+    outs("\n --------------------------------------------------------");
+    outs("\n [Sa]ve   <file>    (adds a snapshot of the game to file)");
+    outs("\n [Loa]d   <file> [n] (resumes from the last or nth snapshot)");
+    outs("\n --------------------------------------------------------");
+    outs("\n [C]ash    <number>  (alters cash amount - cheating!)");
+    outs("\n [Ho]ld    <number>  (change cargo bay size - cheating!)");
+    outs("\n [Sn]eak   <planet>  (any distance, no fuel - cheating!)");
+    outs("\n --------------------------------------------------------");
+    outs("\n [H]elp              (display this text)");
+    outs("\n [R]and              (toggle RNG)");
+    outs("\n [Q]uit              (exit)");
+    outs("\n --------------------------------------------------------");
+    outs("\n Abbreviations allowed, e.g. 'b fo 5' == 'Buy Food 5'");
+    return true;
+}
+
+/** Game setup **/
+
+static void
+inittables(void) /* Once per process, before any context is used */
+{
+    myuint i;
+
+    for (i = 0; i < lasttrade; i++) (void)strcpy(tradnames[i], commodities[i].name);
+
+    buildtrie(&commandtrie, commands, nocomms);
+    buildtrie(&tradetrie, tradnames, lasttrade);
+}
+
+/** Simulation mode **/
+
+#define nopolicies (2)
+
+static const char policynames[nopolicies][maxlen] = {"greedy", "random"};
+
+static const txtelite_policy policyfuncs[nopolicies] = {txtelite_policy_greedy, txtelite_policy_random};
+
+static int
+profitorder(const void *a_, const void *b_) {
+    long a = *(const long *)a_, b = *(const long *)b_;
+
+    return a < b ? -1 : a > b;
+}
+
+static int
+simulate(const universetype *u, int commanders, int jumps, const char *policy, unsigned long seed)
+/*
+ * Headless run of many commanders; prints the
+ * spread of their profits and the jump rate
+ */
+{
+    long *profits;
+    unsigned int *made;
+    double start, secs, mean = 0, var = 0;
+    unsigned long total = 0;
+    int i, p;
+
+    for (p = 0; (p < nopolicies) && (0 != strcmp(policy, policynames[p])); p++)
+        ;
+    if (p == nopolicies) {
+        (void)fprintf(stderr, "Unknown policy %s\n", policy);
+
+        return 1;
+    }
+
+    profits = (long *)malloc((size_t)commanders * sizeof(*profits));
+    made    = (unsigned int *)malloc((size_t)commanders * sizeof(*made));
+    if ((profits == NULL) || (made == NULL)) {
+        (void)fprintf(stderr, "Out of memory\n");
+        free(profits);
+        free(made);
+
+        return 1;
+    }
+
+    start = wallclock();
+    (void)txtelite_simulate(u, commanders, jumps, policyfuncs[p], NULL, seed, profits, made);
+    secs = wallclock() - start;
+
+    for (i = 0; i < commanders; i++) {
+        total += made[i];
+        mean += (double)profits[i];
+    }
+    mean /= commanders;
+    for (i = 0; i < commanders; i++) var += ((double)profits[i] - mean) * ((double)profits[i] - mean);
+    var /= commanders;
+
+    qsort(profits, (size_t)commanders, sizeof(*profits), profitorder);
+
+    (void)printf("Simulated %i commanders for up to %i jumps (%s policy, seed %lu)\n", commanders, jumps, policy, seed);
+    (void)printf("Jumps made: %lu in %.3f s (%.0f jumps/s)\n", total, secs, secs > 0 ? (double)total / secs : 0.0);
+    (void)printf("Profit (CR): mean %.1f, sd %.1f\n", mean / 10, sqrt(var) / 10);
+    (void)printf(" min %.1f, 10%% %.1f, 25%% %.1f, median %.1f, 75%% %.1f, 90%% %.1f, max %.1f\n",
+                 (double)profits[0] / 10, (double)profits[(commanders - 1) / 10] / 10,
+                 (double)profits[(commanders - 1) / 4] / 10, (double)profits[(commanders - 1) / 2] / 10,
+                 (double)profits[(commanders - 1) * 3 / 4] / 10, (double)profits[(commanders - 1) * 9 / 10] / 10,
+                 (double)profits[commanders - 1] / 10);
+
+    free(profits);
+    free(made);
+
+    return 0;
+}
+
+/** Self check **/
+
+static boolean
+samesystem(const plansys *a, const plansys *b) {
+    return (a->x == b->x) && (a->y == b->y) && (a->economy == b->economy) && (a->govtype == b->govtype)
+           && (a->techlev == b->techlev) && (a->population == b->population) && (a->productivity == b->productivity)
+           && (a->radius == b->radius) && (a->human_colony == b->human_colony) && (a->species_type == b->species_type)
+           && (a->species_adj1 == b->species_adj1) && (a->species_adj2 == b->species_adj2)
+           && (a->species_adj3 == b->species_adj3) && (a->goatsoupseed.a == b->goatsoupseed.a)
+           && (a->goatsoupseed.b == b->goatsoupseed.b) && (a->goatsoupseed.c == b->goatsoupseed.c)
+           && (a->goatsoupseed.d == b->goatsoupseed.d) && (0 == strcmp(a->name, b->name));
+}
+
+static int
+checkgalaxies(const universetype *u)
+/*
+ * The galaxies in use, compiled in or built at startup,
+ * against every system generated on its own by
+ * makesystem(); returns how many differ
+ */
+{
+    int bad = 0, galcount;
+    planetnum i;
+
+    for (galcount = 1; galcount <= numgalaxies; galcount++)
+        for (i = 0; i < galsize; i++) {
+            plansys a = unpacksystem(&u->galaxies[galcount - 1], i);
+            plansys b = getsystem((myuint)galcount, i);
+
+            if (!samesystem(&a, &b)) {
+                (void)fprintf(stderr, "Galaxy %d system %d differs from makesystem()\n", galcount, i);
+                bad++;
+            }
+        }
+
+    (void)printf("%d systems checked, %d differ\n", numgalaxies * galsize, bad);
+
+    return bad;
+}
+
+static int
+checkdistances(const universetype *u)
+/*
+ * Integer separation against the floating point formula
+ * it replaced, for every X and Y a galaxy can give, and
+ * the batch kernel against it; returns how many differ
+ */
+{
+    myuint d[galsize];
+    int bad = 0, dx, dy, galcount;
+    planetnum a, b;
+
+    for (dx = -255; dx <= 255; dx++)
+        for (dy = -255; dy <= 255; dy++) {
+            myuint f = (myuint)(signed int)(double)floor(4 * sqrt(dx * dx + dy * dy / 4) + 0.5);
+
+            if (separation(dx, dy) != f) {
+                (void)fprintf(stderr, "Separation of (%d,%d) is %u, not %u\n", dx, dy, separation(dx, dy), f);
+                bad++;
+            }
+        }
+
+    for (galcount = 0; galcount < numgalaxies; galcount++)
+        for (a = 0; a < galsize; a++) {
+            distances(&u->galaxies[galcount], a, d);
+            for (b = 0; b < galsize; b++)
+                if (d[b] != distance(&u->galaxies[galcount], a, b)) {
+                    (void)fprintf(stderr, "Galaxy %d distances from %d differ at %d\n", galcount + 1, a, b);
+                    bad++;
+                }
+        }
+
+    (void)printf("%d separations and %d distances checked, %d differ\n", 511 * 511, numgalaxies * galsize * galsize,
+                 bad);
+
+    return bad;
+}
+
+static int
+selfcheck(const universetype *u) /* Exit status of -selfcheck */
+{
+    int bad = checkgalaxies(u) + checkdistances(u) + checkjournal(u);
+
+    return bad ? 1 : 0;
+}
+
+/** Script mode **/
+
+#define scriptchunk (0x100000) /* Bytes read at a time */
+
+typedef boolean (*piecefunc)(void *arg, const char *piece);
+
+static char *
+splitpieces(char *line, char *end, boolean eof, piecefunc fn, void *arg)
+/*
+ * Pass fn each command from line to end as the prompt
+ * loop would read them: up to a newline, but maxlen-1
+ * characters at most, NUL terminated in place while fn
+ * runs.  Stops when fn returns false.  Returns where
+ * unused input starts: a piece that needs more input
+ * to tell, unless at eof, when the prompt loop would
+ * drop a last line with no newline.  *end must be
+ * writable.
+ */
+{
+    for (;;) {
+        size_t left = (size_t)(end - line);
+        char *nl    = (char *)memchr(line, '\n', (left < maxlen) ? left : maxlen - 1);
+        size_t n;
+        boolean more;
+        char c;
+
+        if (nl != NULL)
+            n = (size_t)(nl - line);
+        else if ((left >= maxlen) || (eof && (left == maxlen - 1)))
+            n = maxlen - 1;
+        else
+            break;
+
+        c       = line[n];
+        line[n] = '\0';
+        more    = (*fn)(arg, line);
+        line[n] = c;
+
+        line += (nl != NULL) ? n + 1 : n;
+        if (!more)
+            break;
+    }
+
+    return line;
+}
+
+static void
+parsepiece(const char *piece, optype *op) /* As the prompt loop would take it */
+{
+    if (NULL == strchr(piece, '\x08')) {
+        parseline(piece, op);
+    } else {
+        (void)memset(op, 0, sizeof(*op));
+        op->command = opaborted;
+    }
+}
+
+static boolean
+scriptpiece(void *ctx_, const char *piece) {
+    contexttype *ctx = (contexttype *)ctx_;
+    optype op;
+
+    parsepiece(piece, &op);
+    outs("\n");
+    (void)journalobey(ctx, piece, &op);
+
+    return !ctx->quit;
+}
+
+static void
+endscript(contexttype *ctx) /* As the prompt loop at end of input */
+{
+    if (!ctx->quit) {
+        outs("\n");
+        (void)doquit(ctx, NULL);
+    }
+}
+
+static boolean
+runscript(contexttype *ctx, FILE *in)
+/*
+ * Obey every line of in, without prompts, until it
+ * ends or a command quits.  Input is read in large
+ * chunks and split into lines where it lies; false if
+ * out of memory.  Output is as from the prompt loop,
+ * less the prompts.
+ */
+{
+    char *buf   = (char *)malloc(scriptchunk + 1);
+    size_t have = 0;
+
+    if (buf == NULL)
+        return false;
+
+    while (!ctx->quit) {
+        size_t got = fread(buf + have, 1, scriptchunk - have, in);
+        char *rest;
+
+        if (got == 0)
+            break;
+
+        have += got;
+        rest = splitpieces(buf, buf + have, false, scriptpiece, ctx);
+        have -= (size_t)(rest - buf);
+        (void)memmove(buf, rest, have);
+    }
+
+    if (!ctx->quit)
+        (void)splitpieces(buf, buf + have, true, scriptpiece, ctx);
+
+    free(buf);
+    endscript(ctx);
+
+    return true;
+}
+
+/*
+ * A script compiled once to be run many times: every
+ * line parsed, and planet names resolved where they
+ * can be, up to the first quit
+ */
+
+typedef struct {
+    const universetype *universe;
+    char *text; /* The script, which ops refer to */
+    optype *ops;
+    size_t n, size;
+    boolean nomem;
+} programtype;
+
+static boolean
+compilepiece(void *prog_, const char *piece) {
+    programtype *prog = (programtype *)prog_;
+    optype *op;
+
+    if (prog->n == prog->size) {
+        size_t size = prog->size ? 2 * prog->size : 256;
+        optype *ops = (optype *)realloc(prog->ops, size * sizeof(*ops));
+
+        if (ops == NULL) {
+            prog->nomem = true;
+
+            return false;
+        }
+
+        prog->ops  = ops;
+        prog->size = size;
+    }
+
+    op = &prog->ops[prog->n++];
+    parsepiece(piece, op);
+    resolveop(prog->universe, op);
+
+    return op->command != quitcommand;
+}
+
+static boolean
+compilescript(programtype *prog, const universetype *u, FILE *in)
+/*
+ * Read all of in and compile it; false if out of memory
+ */
+{
+    size_t len = 0, size = scriptchunk;
+
+    (void)memset(prog, 0, sizeof(*prog));
+    prog->universe = u;
+    prog->text     = (char *)malloc(size + 1);
+    if (prog->text == NULL)
+        return false;
+
+    for (;;) {
+        size_t got = fread(prog->text + len, 1, size - len, in);
+
+        len += got;
+        if (got == 0)
+            break;
+
+        if (len == size) {
+            char *text = (char *)realloc(prog->text, 2 * size + 1);
+
+            if (text == NULL)
+                return false;
+
+            prog->text = text;
+            size *= 2;
+        }
+    }
+
+    (void)splitpieces(prog->text, prog->text + len, true, compilepiece, prog);
+
+    return !prog->nomem;
+}
+
+static void
+freeprogram(programtype *prog) {
+    free(prog->ops);
+    free(prog->text);
+}
+
+static void
+runprogram(contexttype *ctx, const programtype *prog) /* Output as runscript */
+{
+    size_t k;
 
-            prisys(galaxy[syscount], true);
-            (void)printf(" (%.1f LY)", (double)((float)d / 10));
-        }
+    for (k = 0; (k < prog->n) && !ctx->quit; k++) {
+        outs("\n");
+        (void)obey(ctx, &prog->ops[k]);
     }
 
-    return true;
+    endscript(ctx);
 }
 
-static boolean
-dojump(char *s)
+static int
+replay(contexttype *ctx, const universetype *u, int runs, unsigned long seed)
 /*
- * Jump to planet name s
+ * Compile the script on stdin, then run it runs times
+ * from the start of the game, seeding run r with
+ * seed+r, and sum up each run
  */
 {
-    myuint d;
-    planetnum dest = matchsys(s);
+    programtype prog;
+    int r;
 
-    if (dest == currentplanet) {
-        (void)printf("Bad jump");
+    if (!compilescript(&prog, u, stdin)) {
+        freeprogram(&prog);
+        (void)fprintf(stderr, "Out of memory\n");
 
-        return false;
+        return 1;
     }
 
-    d = distance(galaxy[dest], galaxy[currentplanet]);
-    if (d > fuel) {
-        (void)printf("Jump to far");
+    for (r = 0; r < runs; r++) {
+        initcontext(ctx, u, true);
+        mysrand(ctx, (unsigned int)(seed + (unsigned long)r));
+        (void)parser(ctx, "hold 20");
+        (void)parser(ctx, "cash +100");
 
-        return false;
+        runprogram(ctx, &prog);
+        outflush();
+
+        (void)printf("Run %i (seed %lu): %.1f CR, %.1f LY of fuel, at %s in galaxy %u\n", r,
+                     seed + (unsigned long)r, (double)ctx->cash / 10, (double)ctx->fuel / 10,
+                     ctx->galaxy->name[ctx->currentplanet], ctx->galaxynum);
+        (void)fflush(stdout);
     }
 
-    fuel -= d;
-    gamejump(dest);
-    prisys(galaxy[currentplanet], false);
+    freeprogram(&prog);
 
-    return true;
+    return 0;
 }
 
-static boolean
-dosneak(char *s)
+/** Journal **/
+
 /*
- * As dojump but no fuel cost
+ * Every command obeyed, as text, with the random numbers it
+ * drew and the weak generator's state after it; before every
+ * interval'th command, a checkpoint of the game.  Records
+ * are of fixed size, so command k and the checkpoint before
+ * it are found without reading the rest, and the journal is
+ * only ever appended to.  libc's random state is kept as its
+ * seed and the draws since, as that is all it can be rebuilt
+ * from.  A load's snapshot goes to a second file, the
+ * journal's name with ".loads" added, so that seeking
+ * restores what was loaded then rather than what the file
+ * holds now, and a save is not written again.
  */
-{
-    myuint fuelkeep = fuel;
-    boolean b;
 
-    fuel = 666;
-    b    = dojump(s);
-    fuel = fuelkeep;
+#define journalmagic    (0x54454A32U) /* "TEJ2" */
+#define journalinterval (1000)        /* Default */
+#define loadssuffix     ".loads"
 
-    return b;
-}
+typedef struct {
+    unsigned int magic;
+    unsigned int interval; /* Commands between checkpoints */
+    unsigned int spare[6];
+} journalhead;
 
-static boolean
-dogalhyp(char *s)
+typedef struct {
+    snapshottype snap;
+    unsigned int nativeseed;
+    unsigned int nativedraws;
+    unsigned int spare[6];
+} checkpointtype;
+
+typedef struct {
+    unsigned int lastrand; /* Weak generator after the command */
+    unsigned int draws;    /* Random numbers it drew */
+    unsigned int loaded;   /* For a load, 1 + its snapshot's index in the loads file */
+    char text[maxlen];     /* The command, NUL padded */
+} entrytype;
+
+typedef struct {
+    FILE *f;
+    FILE *loads; /* Opened at the first load */
+    const char *name;
+    unsigned long interval;
+    unsigned long count;  /* Commands so far */
+    unsigned long loaded; /* Snapshots in loads */
+    boolean failed;
+} journaltype;
+
+static journaltype journal;
+
+static long
+journalpos(unsigned long interval, unsigned long k, boolean checkpoint)
 /*
- * Jump to next galaxy
- * Preserve planetnum (eg. if leave 7th
- * planet arrive at 7th planet)
+ * Offset of command k, or of the checkpoint before it
+ * when k is a multiple of interval
  */
 {
-    (void)(s); /* Discard s */
+    long pos = (long)sizeof(journalhead)
+               + (long)(k / interval) * (long)(sizeof(checkpointtype) + interval * sizeof(entrytype));
+
+    if (!checkpoint)
+        pos += (long)(sizeof(checkpointtype) + (k % interval) * sizeof(entrytype));
+
+    return pos;
+}
+
+static FILE *
+openloads(const char *name, const char *mode) /* The loads file of journal name */
+{
+    size_t len = strlen(name);
+    char *s    = (char *)malloc(len + sizeof(loadssuffix));
+    FILE *f;
 
-    galaxynum++;
-    if (galaxynum == 9)
-        galaxynum = 1;
+    if (s == NULL)
+        return NULL;
 
-    buildgalaxy(galaxynum);
+    (void)memcpy(s, name, len);
+    (void)memcpy(s + len, loadssuffix, sizeof(loadssuffix));
+    f = fopen(s, mode);
+    free(s);
 
-    (void)printf("Jumped to galaxy %u", galaxynum);
+    return f;
+}
 
-    return true;
+static boolean
+openjournal(const char *name, unsigned long interval) {
+    journalhead head;
+
+    (void)memset(&head, 0, sizeof(head));
+    head.magic    = journalmagic;
+    head.interval = (unsigned int)interval;
+
+    journal.f        = fopen(name, "wb");
+    journal.loads    = NULL;
+    journal.name     = name;
+    journal.interval = interval;
+    journal.count    = 0;
+    journal.loaded   = 0;
+    journal.failed   = (journal.f == NULL) || (fwrite(&head, sizeof(head), 1, journal.f) != 1);
+
+    return !journal.failed;
 }
 
 static boolean
-doinfo(char *s)
-/*
- * Info on planet
- */
+closejournal(void) /* False if anything failed to be written */
 {
-    planetnum dest = matchsys(s);
+    if ((journal.f != NULL) && (fclose(journal.f) != 0))
+        journal.failed = true;
 
-    prisys(galaxy[dest], false);
+    if ((journal.loads != NULL) && (fclose(journal.loads) != 0))
+        journal.failed = true;
 
-    return true;
+    journal.f     = NULL;
+    journal.loads = NULL;
+
+    return !journal.failed;
 }
 
 static boolean
-dohold(char *s) {
-    myuint a = (myuint)atoi(s), t = 0, i;
+journalobey(contexttype *ctx, const char *s, const optype *op)
+/*
+ * Obey op, parsed from s, and journal it
+ */
+{
+    unsigned long draws = ctx->draws;
+    checkpointtype check;
+    entrytype entry;
+    snapshottype snap;
+    boolean ok;
+
+    if ((journal.f == NULL) || journal.failed)
+        return obey(ctx, op);
+
+    if (journal.count % journal.interval == 0) {
+        (void)memset(&check, 0, sizeof(check));
+        savesnapshot(ctx, &check.snap);
+        check.nativeseed  = ctx->nativeseed;
+        check.nativedraws = (unsigned int)ctx->nativedraws;
+        if (fwrite(&check, sizeof(check), 1, journal.f) != 1)
+            journal.failed = true;
+    }
 
-    for (i = 0; i <= lasttrade; ++i)
-        if ((commodities[i].units) == tonnes)
-            t += shipshold[i];
+    ok = obey(ctx, op);
 
-    if (t > a) {
-        (void)printf("Hold too full");
+    (void)memset(&entry, 0, sizeof(entry));
+    entry.lastrand = ctx->rng.lastrand;
+    entry.draws    = (unsigned int)(ctx->draws - draws);
+    (void)strncpy(entry.text, s, sizeof(entry.text) - 1);
+    if (ok && (op->command == loadcommand)) {
+        savesnapshot(ctx, &snap);
+        if (journal.loads == NULL)
+            journal.loads = openloads(journal.name, "wb");
 
-        return false;
+        if ((journal.loads == NULL) || (fwrite(&snap, sizeof(snap), 1, journal.loads) != 1))
+            journal.failed = true;
+
+        entry.loaded = (unsigned int)++journal.loaded;
     }
 
-    holdspace = a - t;
+    if (fwrite(&entry, sizeof(entry), 1, journal.f) != 1)
+        journal.failed = true;
 
-    return true;
+    journal.count++;
+
+    return ok;
 }
 
 static boolean
-dosell(char *s)
+seekjournal(contexttype *ctx, const char *name, unsigned long k)
 /*
- * Sell amount s(2) of good s(1)
+ * Bring ctx to where it was before command k of journal
+ * name: from the last checkpoint before it, obeying the
+ * commands since with output discarded and checking that
+ * each draws as it did.  Loads restore the snapshot they
+ * loaded then; saves write nothing.  False, with a message,
+ * if the journal cannot be read that far.
  */
 {
-    myuint i, a, t;
-    char s2[maxlen];
+    FILE *f = fopen(name, "rb"), *loads = NULL;
+    boolean discard = sink.discard, ok;
+    journalhead head;
+    checkpointtype check;
+    entrytype entry;
+    snapshottype snap;
+    unsigned long i, from, n;
+
+    ok = (f != NULL) && (fread(&head, sizeof(head), 1, f) == 1) && (head.magic == journalmagic) && (head.interval > 0);
+    if (!ok) {
+        (void)fprintf(stderr, "Cannot read journal %s\n", name);
+        if (f != NULL)
+            (void)fclose(f);
 
-    spacesplit(s, s2);
-    a = (myuint)atoi(s);
-    if (a == 0)
-        a = 1;
+        return false;
+    }
 
-    i = stringmatch(s2, tradnames, lasttrade + 1);
-    if (i == 0) {
-        (void)printf("Unknown trade good");
+    from = k - k % head.interval;
+    for (;;) {
+        ok = (fseek(f, journalpos(head.interval, from, true), SEEK_SET) == 0)
+             && (fread(&check, sizeof(check), 1, f) == 1) && loadsnapshot(ctx, &check.snap);
+        if (ok || (from == 0))
+            break;
+
+        from -= head.interval; /* k may be the end, just after a full block */
+    }
+
+    if (!ok) {
+        (void)fprintf(stderr, "No checkpoint for command %lu in %s\n", k, name);
+        (void)fclose(f);
 
         return false;
     }
 
-    i -= 1;
+    srand(check.nativeseed);
+    for (n = 0; n < check.nativedraws; n++) (void)rand();
 
-    t = gamesell(i, a);
+    ctx->nativeseed  = check.nativeseed;
+    ctx->nativedraws = check.nativedraws;
 
-    if (t == 0) {
-        (void)printf("Cannot sell any ");
-    } else {
-        (void)printf("Selling %i", t);
-        (void)printf("%s", unitnames[commodities[i].units]);
-        (void)printf(" of ");
+    sink.discard = true;
+    seeking      = true;
+    ok           = (fseek(f, journalpos(head.interval, from, false), SEEK_SET) == 0);
+    for (i = from; ok && (i < k); i++) {
+        unsigned long draws = ctx->draws;
+        optype op;
+
+        ok = (fread(&entry, sizeof(entry), 1, f) == 1);
+        if (!ok) {
+            (void)fprintf(stderr, "Journal %s ends at command %lu\n", name, i);
+            break;
+        }
+
+        entry.text[sizeof(entry.text) - 1] = '\0';
+        parsepiece(entry.text, &op);
+        if (op.command != loadcommand)
+            (void)obey(ctx, &op);
+        else if (entry.loaded > 0) { /* A load that failed changed nothing */
+            if (loads == NULL)
+                loads = openloads(name, "rb");
+
+            ok = (loads != NULL) && (fseek(loads, (long)(entry.loaded - 1) * (long)sizeof(snap), SEEK_SET) == 0)
+                 && (fread(&snap, sizeof(snap), 1, loads) == 1) && loadsnapshot(ctx, &snap);
+            if (!ok) {
+                (void)fprintf(stderr, "Cannot read the snapshot loaded by command %lu of %s\n", i, name);
+                break;
+            }
+        }
+
+        if ((ctx->draws - draws != entry.draws) || (ctx->rng.lastrand != entry.lastrand))
+            (void)fprintf(stderr, "Journal %s diverges at command %lu (%s)\n", name, i, entry.text);
     }
 
-    (void)printf("%s", tradnames[i]);
+    sink.discard = discard;
+    seeking      = false;
+    (void)fclose(f);
+    if (loads != NULL)
+        (void)fclose(loads);
 
-    return true;
+    return ok;
 }
 
-static boolean
-dobuy(char *s)
+#define checkname     "txtelite.jnl" /* Made and removed by -selfcheck */
+#define checksave     "txtelite.sav"
+#define checkcommands (16)
+
+static unsigned long
+filesum(const char *name) /* Length and bytes of file name folded together, 0 if absent */
+{
+    FILE *f = fopen(name, "rb");
+    unsigned long sum = 0;
+    int c;
+
+    if (f == NULL)
+        return 0;
+
+    while ((c = getc(f)) != EOF) sum = sum * 31 + (unsigned long)c + 1;
+
+    (void)fclose(f);
+
+    return sum;
+}
+
+static int
+checkjournal(const universetype *u)
 /*
- * Buy amount s(2) of good s(1)
+ * Journal a game that saves and loads, overwrite the file
+ * it saved to, then seek to every command of it: each seek
+ * must give the game as it was then and leave the files
+ * as they are; returns how many seeks differ
  */
 {
-    myuint i, a, t;
-    char s2[maxlen];
+    static const char *const script[checkcommands] = {
+        "hold 20",   "cash +100",   "save " checksave,      "jump zaonce", "buy food 3",      "save " checksave,
+        "rand",      "jump lave",   "load " checksave " 0", "sell food 3", "load " checksave, "load nosuch.sav",
+        "jump diso", "save " checksave, "cash +5",          "load " checksave " 1"};
+    static contexttype a, b;
+    snapshottype states[checkcommands + 1], snap;
+    unsigned long sums[3];
+    boolean discard = sink.discard;
+    int bad = 0, k;
+    FILE *f;
+
+    (void)remove(checkname);
+    (void)remove(checksave);
+    (void)remove(checkname loadssuffix);
+
+    sink.discard = true;
+    initcontext(&a, u, true);
+    if (!openjournal(checkname, 4)) {
+        (void)fprintf(stderr, "Cannot write %s\n", checkname);
+        sink.discard = discard;
+
+        return 1;
+    }
 
-    spacesplit(s, s2);
-    a = (myuint)atoi(s);
-    if (a == 0)
-        a = 1;
+    for (k = 0; k < checkcommands; k++) {
+        savesnapshot(&a, &states[k]);
+        (void)parser(&a, script[k]);
+    }
 
-    i = stringmatch(s2, tradnames, lasttrade + 1);
-    if (i == 0) {
-        (void)printf("Unknown trade good");
+    savesnapshot(&a, &states[checkcommands]);
+    if (!closejournal()) {
+        (void)fprintf(stderr, "Cannot write %s\n", checkname);
+        bad++;
+    }
 
-        return false;
+    f = fopen(checksave, "wb"); /* Not what the journal loaded */
+    if ((f == NULL) || (fwrite(&states[0], sizeof(states[0]), 1, f) != 1) || (fclose(f) != 0)) {
+        (void)fprintf(stderr, "Cannot write %s\n", checksave);
+        bad++;
     }
 
-    i -= 1;
+    sums[0] = filesum(checkname);
+    sums[1] = filesum(checksave);
+    sums[2] = filesum(checkname loadssuffix);
 
-    t = gamebuy(i, a);
-    if (t == 0) {
-        (void)printf("Cannot buy any ");
-    } else {
-        (void)printf("Buying %i", t);
-        (void)printf("%s", unitnames[commodities[i].units]);
-        (void)printf(" of ");
+    for (k = 0; k <= checkcommands; k++) {
+        (void)memset(&snap, 0, sizeof(snap));
+        initcontext(&b, u, true);
+        if (seekjournal(&b, checkname, (unsigned long)k))
+            savesnapshot(&b, &snap);
+
+        if (memcmp(&snap, &states[k], sizeof(snap)) != 0) {
+            (void)fprintf(stderr, "Seeking to command %d of %s differs from the game\n", k, checkname);
+            bad++;
+        }
+    }
+
+    if ((filesum(checkname) != sums[0]) || (filesum(checksave) != sums[1])
+        || (filesum(checkname loadssuffix) != sums[2])) {
+        (void)fprintf(stderr, "Seeking in %s changed a file\n", checkname);
+        bad++;
     }
 
-    (void)printf("%s", tradnames[i]);
+    sink.discard = discard;
+    (void)remove(checkname);
+    (void)remove(checksave);
+    (void)remove(checkname loadssuffix);
 
-    return true;
+    (void)printf("%d seeks across saves and loads checked, %d differ\n", checkcommands + 1, bad);
+
+    return bad;
 }
 
-static myuint
-gamefuel(myuint f)
+/** Export **/
+
 /*
- * Attempt to buy f tonnes of fuel
+ * The universe streamed out column by column, as read by
+ * txtelite_export_open.  Galaxy attributes and markets are
+ * written straight from their arrays and strings as they
+ * are generated, so nothing is built up in memory but the
+ * descriptions, which are cached anyway.
  */
-{
-    if (f + fuel > maxfuel)
-        f = (myuint)maxfuel - fuel;
 
-    if (fuelcost > 0) {
-        if ((int)f * fuelcost > cash)
-            f = (myuint)(cash / fuelcost);
-    }
+#define colfield   (0) /* Galaxy attribute at field */
+#define colgalaxy  (1)
+#define colsystem  (2)
+#define colseed    (3) /* Byte field of goatsoupseed */
+#define colname    (4) /* Strings, in heap in this order */
+#define colspecies (5)
+#define coldesc    (6)
+#define colprice   (7)
+#define colquant   (8)
+#define colheap    (9)
 
-    fuel += f;
-    cash -= fuelcost * f;
+#define nostrings  (3)
+#define exportrows (numgalaxies * galsize)
 
-    return f;
-}
+typedef struct {
+    const char *name;
+    unsigned int type;
+    int kind;
+    size_t field;
+} exportcolumn;
+
+static const exportcolumn exportcolumns[] = {
+    {"galaxy", TXTELITE_U8, colgalaxy, 0},
+    {"system", TXTELITE_U8, colsystem, 0},
+    {"x", TXTELITE_U8, colfield, offsetof(galaxytype, x)},
+    {"y", TXTELITE_U8, colfield, offsetof(galaxytype, y)},
+    {"economy", TXTELITE_U8, colfield, offsetof(galaxytype, economy)},
+    {"govtype", TXTELITE_U8, colfield, offsetof(galaxytype, govtype)},
+    {"techlev", TXTELITE_U8, colfield, offsetof(galaxytype, techlev)},
+    {"population", TXTELITE_U8, colfield, offsetof(galaxytype, population)},
+    {"productivity", TXTELITE_U16, colfield, offsetof(galaxytype, productivity)},
+    {"radius", TXTELITE_U16, colfield, offsetof(galaxytype, radius)},
+    {"human_colony", TXTELITE_U8, colfield, offsetof(galaxytype, human_colony)},
+    {"species_type", TXTELITE_U8, colfield, offsetof(galaxytype, species_type)},
+    {"species_adj1", TXTELITE_U8, colfield, offsetof(galaxytype, species_adj1)},
+    {"species_adj2", TXTELITE_U8, colfield, offsetof(galaxytype, species_adj2)},
+    {"species_adj3", TXTELITE_U8, colfield, offsetof(galaxytype, species_adj3)},
+    {"goatsoupseed_a", TXTELITE_U8, colseed, 0},
+    {"goatsoupseed_b", TXTELITE_U8, colseed, 1},
+    {"goatsoupseed_c", TXTELITE_U8, colseed, 2},
+    {"goatsoupseed_d", TXTELITE_U8, colseed, 3},
+    {"name", TXTELITE_STRING, colname, 0},
+    {"species", TXTELITE_STRING, colspecies, 0},
+    {"description", TXTELITE_STRING, coldesc, 0},
+    {"market_price", TXTELITE_U16, colprice, 0},
+    {"market_quantity", TXTELITE_U8, colquant, 0},
+    {"heap", TXTELITE_U8, colheap, 0},
+};
 
-static boolean
-dofuel(char *s)
+#define nocolumns (sizeof(exportcolumns) / sizeof(exportcolumns[0]))
+
+static const char *
+exportstring(const contexttype *ctx, int kind, planetnum i, char *buf, size_t *len)
 /*
- * Buy amount s of fuel
+ * String of kind for system i of the current galaxy, not
+ * terminated, using buf (desclen bytes) if need be; NULL
+ * if out of memory
  */
 {
-    myuint f = gamefuel((myuint)(double)floor(10 * atof(s)));
-
-    if (f == 0) {
-        (void)printf("Cannot buy any fuel");
-
-        return false;
+    switch (kind) {
+        case colname: *len = strlen(ctx->galaxy->name[i]); return ctx->galaxy->name[i];
+        case colspecies: *len = describespecies(ctx->galaxy, i, buf, desclen); return buf;
+        default: return cacheddesc(ctx, i, len);
     }
-
-    (void)printf("Buying %.1fLY fuel", (double)((float)f / 10));
-
-    return true;
 }
 
 static boolean
-docash(char *s)
+exportstrings(FILE *f, contexttype *ctx, int kind, unsigned int *start)
 /*
- * Cheat alter cash by s
+ * Heap offsets of strings of kind, from *start, and one
+ * past the last, left in *start; just that if f is NULL.
+ * False if out of memory or a write fails.
  */
 {
-    int a = (int)(10 * atof(s));
+    unsigned int off[galsize];
+    char buf[desclen];
+    myuint galcount;
+    planetnum i;
 
-    cash += (long)a;
-    if (a != 0)
-        return true;
+    for (galcount = 1; galcount <= numgalaxies; galcount++) {
+        gamegalaxy(ctx, galcount);
+        for (i = 0; i < galsize; i++) {
+            size_t len;
 
-    (void)printf("Number not understood");
+            if (exportstring(ctx, kind, i, buf, &len) == NULL)
+                return false;
 
-    return false;
+            off[i] = *start;
+            *start += (unsigned int)len + 1;
+        }
+
+        if ((f != NULL) && (fwrite(off, sizeof(off[0]), galsize, f) != galsize))
+            return false;
+    }
+
+    return (f == NULL) || (fwrite(start, sizeof(*start), 1, f) == 1);
 }
 
 static boolean
-domkt(char *s)
-/*
- * Show stock market
- */
+exportheap(FILE *f, contexttype *ctx) /* All strings, each NUL terminated */
 {
-    (void)s;
-    displaymarket(localmarket);
+    char buf[desclen];
+    myuint galcount;
+    planetnum i;
+    int kind;
+
+    for (kind = colname; kind < colname + nostrings; kind++)
+        for (galcount = 1; galcount <= numgalaxies; galcount++) {
+            gamegalaxy(ctx, galcount);
+            for (i = 0; i < galsize; i++) {
+                size_t len;
+                const char *s = exportstring(ctx, kind, i, buf, &len);
+
+                if ((s == NULL) || (fwrite(s, 1, len, f) != len) || (putc('\0', f) == EOF))
+                    return false;
+            }
+        }
+
+    return true;
+}
+
+static boolean
+exportvalues(FILE *f, contexttype *ctx, const exportcolumn *col, unsigned int *heapstart) {
+    const universetype *u = ctx->universe;
+    uint8 bytes[galsize];
+    myuint galcount;
+    planetnum i;
+
+    switch (col->kind) {
+        case colname:
+        case colspecies:
+        case coldesc: return exportstrings(f, ctx, col->kind, &heapstart[col->kind - colname]);
+        case colprice: return fwrite(u->markets.price, sizeof(u->markets.price), 1, f) == 1;
+        case colquant: return fwrite(u->markets.quantity, sizeof(u->markets.quantity), 1, f) == 1;
+        case colheap: return exportheap(f, ctx);
+        default: break;
+    }
+
+    for (galcount = 0; galcount < numgalaxies; galcount++) {
+        const galaxytype *g = &u->galaxies[galcount];
+
+        switch (col->kind) {
+            case colfield:
+                if (fwrite((const char *)g + col->field, col->type, galsize, f) != galsize)
+                    return false;
+
+                continue;
+            case colgalaxy: (void)memset(bytes, galcount + 1, galsize); break; /* 1-8, as elsewhere */
+            case colsystem:
+                for (i = 0; i < galsize; i++) bytes[i] = (uint8)i;
+                break;
+            default:
+                for (i = 0; i < galsize; i++) bytes[i] = ((const uint8 *)&g->goatsoupseed[i])[col->field];
+                break;
+        }
+
+        if (fwrite(bytes, 1, galsize, f) != galsize)
+            return false;
+    }
 
     return true;
 }
 
 static boolean
-parser(char *s)
+exportuniverse(const universetype *u, const char *name)
 /*
- * Obey command s
+ * Write the export file name; false if that fails
  */
 {
-    myuint i;
-    char c[maxlen];
-
-    if (feof(stdin))
-        doquit(NULL); /* Catch EOF */
+    static contexttype context;
+    contexttype *ctx = &context;
+    txtelite_export_head head;
+    txtelite_column dir[nocolumns];
+    unsigned int heapstart[nostrings], heapsize = 0, pos;
+    boolean ok = true;
+    size_t k;
+    int kind;
+    FILE *f;
+
+    initcontext(ctx, u, false);
+    for (kind = 0; kind < nostrings; kind++) {
+        heapstart[kind] = heapsize;
+        if (!exportstrings(NULL, ctx, colname + kind, &heapsize))
+            return false;
+    }
 
-    if (0 == strcmp(s, "")) {
-        (void)printf(" Error: Empty command");
+    (void)memset(&head, 0, sizeof(head));
+    (void)memset(dir, 0, sizeof(dir));
+    pos = (unsigned int)(sizeof(head) + sizeof(dir));
+    for (k = 0; k < nocolumns; k++) {
+        const exportcolumn *col = &exportcolumns[k];
+        txtelite_column *c      = &dir[k];
+        (void)strncpy(c->name, col->name, sizeof(c->name));
+        c->type = col->type;
+        switch (col->kind) {
+            case colprice:
+            case colquant: c->count = numeconomies * (lasttrade + 1) * 256; break;
+            case colheap: c->count = heapsize; break;
+            default: c->count = (col->type == TXTELITE_STRING) ? exportrows + 1 : exportrows; break;
+        }
 
-        return false;
+        pos       = (pos + exportalign - 1) / exportalign * exportalign;
+        c->offset = pos;
+        pos += c->count * colwidth(c->type);
     }
 
-    spacesplit(s, c);
-    i = stringmatch(c, commands, nocomms);
-
-    if (i)
-        return (*comfuncs[i - 1])(s);
+    head.magic   = TXTELITE_EXPORT_MAGIC;
+    head.columns = nocolumns;
+    head.rows    = exportrows;
+    head.size    = pos;
 
-    (void)printf(" Error: Bad command (%s)", c);
+    f = fopen(name, "wb");
+    if (f == NULL)
+        return false;
 
-    return false;
-}
+    ok  = (fwrite(&head, sizeof(head), 1, f) == 1) && (fwrite(dir, sizeof(dir), 1, f) == 1);
+    pos = (unsigned int)(sizeof(head) + sizeof(dir));
+    for (k = 0; ok && (k < nocolumns); k++) {
+        for (; ok && (pos < dir[k].offset); pos++) ok = (putc('\0', f) != EOF);
 
-static boolean
-doquit(char *s) {
-    (void)(&s);
-    (void)puts("\n\nQuit.");
+        ok  = ok && exportvalues(f, ctx, &exportcolumns[k], heapstart);
+        pos = (unsigned int)ftell(f);
+        ok  = ok && (pos == dir[k].offset + dir[k].count * colwidth(dir[k].type)); /* As the directory says */
+    }
 
-    exit(0);
-}
+    if (fclose(f) != 0)
+        ok = false;
 
-boolean
-dohelp(char *s) {
-    (void)(&s);
-    (void)printf(" Commands are:");
-    (void)printf("\n --------------------------------------------------------");
-    (void)printf("\n [B]uy     <tradegood> <amount>");
-    (void)printf("\n [S]ell    <tradegood> <amount>");
-    (void)printf("\n [F]uel    <amount>  (buy amount LY of fuel)");
-    (void)printf("\n --------------------------------------------------------");
-    (void)printf("\n [J]ump    <planet>  (limited by fuel)");
-    (void)printf("\n [G]alhyp            (jumps to next galaxy)");
-    (void)printf("\n --------------------------------------------------------");
-    (void)printf("\n [I]nfo    [planet]  (prints info on system)");
-    (void)printf("\n [M]kt               (shows market prices)");
-    (void)printf("\n [L]ocal             (lists systems within 7 light years)");
-    (void)printf("\n --------------------------------------------------------");
-    (void)printf("\n [C]ash    <number>  (alters cash amount - cheating!)");
-    (void)printf("\n [Ho]ld    <number>  (change cargo bay size - cheating!)");
-    (void)printf("\n [Sn]eak   <planet>  (any distance, no fuel - cheating!)");
-    (void)printf("\n --------------------------------------------------------");
-    (void)printf("\n [H]elp              (display this text)");
-    (void)printf("\n [R]and              (toggle RNG)");
-    (void)printf("\n [Q]uit              (exit)");
-    (void)printf("\n --------------------------------------------------------");
-    (void)printf("\n Abbreviations allowed, e.g. 'b fo 5' == 'Buy Food 5'");
-    return true;
+    return ok;
 }
 
 /** main **/
 int
-main(void) {
-    myuint i;
+main(int argc, char *argv[]) {
+    static universetype universe;
+    static contexttype commander;
+    contexttype *ctx = &commander;
+    const char *policy = policynames[0], *journalname = NULL, *seekname = NULL, *exportname = NULL;
+    unsigned long seed = 1, interval = journalinterval, seekto = 0;
+    int commanders = 0, jumps = 0, replays = 0, i;
+    boolean script = false, seeded = false, check = false;
+
+    for (i = 1; i < argc; i++) {
+        if ((0 == strcmp(argv[i], "-simulate")) && (i + 2 < argc)) {
+            commanders = atoi(argv[++i]);
+            jumps      = atoi(argv[++i]);
+        } else if ((0 == strcmp(argv[i], "-policy")) && (i + 1 < argc)) {
+            policy = argv[++i];
+        } else if ((0 == strcmp(argv[i], "-seed")) && (i + 1 < argc)) {
+            seed   = strtoul(argv[++i], NULL, 10);
+            seeded = true;
+        } else if ((0 == strcmp(argv[i], "-threads")) && (i + 1 < argc)) {
+            txtelite_threads(atoi(argv[++i]));
+        } else if (0 == strcmp(argv[i], "-selfcheck")) {
+            check = true;
+        } else if (0 == strcmp(argv[i], "-script")) {
+            script = true;
+        } else if ((0 == strcmp(argv[i], "-replay")) && (i + 1 < argc)) {
+            replays = atoi(argv[++i]);
+        } else if ((0 == strcmp(argv[i], "-journal")) && (i + 1 < argc)) {
+            journalname = argv[++i];
+        } else if ((0 == strcmp(argv[i], "-checkpoint")) && (i + 1 < argc) && (atol(argv[i + 1]) > 0)) {
+            interval = (unsigned long)atol(argv[++i]);
+        } else if ((0 == strcmp(argv[i], "-export")) && (i + 1 < argc)) {
+            exportname = argv[++i];
+        } else if ((0 == strcmp(argv[i], "-seek")) && (i + 2 < argc)) {
+            seekname = argv[++i];
+            seekto   = strtoul(argv[++i], NULL, 10);
+        } else if ((0 == strcmp(argv[i], "-output")) && (i + 1 < argc) &&
+                   ((0 == strcmp(argv[i + 1], sinknames[0])) || (0 == strcmp(argv[i + 1], sinknames[1])))) {
+            sink.discard = (0 == strcmp(argv[++i], sinknames[1]));
+        } else {
+            (void)fprintf(stderr,
+                          "Usage: %s [-threads n] [-output buffered|null] [-script | -replay runs [-seed n]]"
+                          " [-journal file [-checkpoint n]] [-seek journal command] [-export file] [-selfcheck]"
+                          " [-simulate commanders jumps [-policy greedy|random] [-seed n]]\n",
+                          argv[0]);
 
-    nativerand = 1;
+            return 1;
+        }
+    }
 
-    (void)printf("\nWelcome to Text Elite 1.5.\n\n");
+    if ((replays > 0) && ((journalname != NULL) || (seekname != NULL))) {
+        (void)fprintf(stderr, "%s: -replay cannot be combined with -journal or -seek\n", argv[0]);
 
-    for (i = 0; i < lasttrade; i++) (void)strcpy(tradnames[i], commodities[i].name);
+        return 1;
+    }
+
+    if (commanders > 0) {
+        if (!builduniverse(&universe)) {
+            (void)fprintf(stderr, "Out of memory\n");
+
+            return 1;
+        }
+
+        return simulate(&universe, commanders, jumps, policy, seed);
+    }
+
+    if (check) {
+        inittables();
+        if (!builduniverse(&universe)) {
+            (void)fprintf(stderr, "Out of memory\n");
+
+            return 1;
+        }
+
+        return selfcheck(&universe);
+    }
+
+    if (exportname != NULL) {
+        if (!builduniverse(&universe) || !exportuniverse(&universe, exportname)) {
+            (void)fprintf(stderr, "Cannot export to %s\n", exportname);
+
+            return 1;
+        }
+
+        return 0;
+    }
 
-    mysrand(12345); /* Ensure repeatability */
+    outs("\nWelcome to Text Elite 1.5.\n\n");
 
-    galaxynum = 1;
-    buildgalaxy(galaxynum);
+    inittables();
+    if (!builduniverse(&universe)) {
+        outs("Out of memory\n");
+        outflush();
 
-    currentplanet = numforLave;                          /* Don't use jump */
-    localmarket   = genmarket(0x00, galaxy[numforLave]); /* Since want seed=0 */
+        return 1;
+    }
+
+    if (replays > 0)
+        return replay(ctx, &universe, replays, seeded ? seed : 12345);
+
+    initcontext(ctx, &universe, true);
+
+    if ((seekname != NULL) && !seekjournal(ctx, seekname, seekto))
+        return 1;
 
-    fuel = (myuint)maxfuel;
+    if ((journalname != NULL) && !openjournal(journalname, interval)) {
+        (void)fprintf(stderr, "Cannot write journal %s\n", journalname);
 
-#define PARSER(S)             \
-    {                         \
-        char buf[0x10];       \
-        (void)strcpy(buf, S); \
-        (void)parser(buf);    \
+        return 1;
     }
 
-    PARSER("hold 20")   /* Small cargo bay */
-    PARSER("cash +100") /* 100 CR */
-    PARSER("help")
+    if (seekname == NULL) {
+        (void)parser(ctx, "hold 20");   /* Small cargo bay */
+        (void)parser(ctx, "cash +100"); /* 100 CR */
+        (void)parser(ctx, "help");
+    }
 
-#undef PARSER
+    if (script && !runscript(ctx, stdin)) {
+        outs("\nOut of memory\n");
+        outflush();
 
-    for(;;) {
-        (void)printf("\n\nFuel:%.1f", (double)((float)fuel / 10));
-        (void)printf(" Holdspace:%it", holdspace);
-        (void)printf(" Cash:%.1f > ", (double)(((float)cash) / 10));
+        return 1;
+    }
 
+    while (!ctx->quit) {
         char getcommand[maxlen];
+
+        outs("\n\nFuel:");
+        outtenths((long)ctx->fuel, 0, false);
+        outf(" Holdspace:%it Cash:", ctx->holdspace);
+        outtenths((long)ctx->cash, 0, false);
+        outs(" > ");
+
         (void)memset(getcommand, 0, maxlen);
 
-        (void)fflush(stdout);
+        outflush();
 
         if (fgets(getcommand, maxlen, stdin)) {
             getcommand[strcspn(getcommand, "\n")] = '\0';
         }
 
         if (NULL == strstr(getcommand, "\x08")) {
-            (void)printf("\n");
-            (void)parser(getcommand);
+            outs("\n");
+            if (feof(stdin))
+                (void)doquit(ctx, NULL); /* Catch EOF */
+            else
+                (void)parser(ctx, getcommand);
         } else {
-            (void)printf("\n Error: Aborted command");
+            outs("\n Error: Aborted command");
         }
     }
 
+    outflush();
+
+    if (!closejournal()) {
+        (void)fprintf(stderr, "Cannot write journal %s\n", journalname);
+
+        return 1;
+    }
+
     /*
      * 6502 Elite fires up at Lave with fluctuation=00
      * and these prices tally with the NES ones.
@@ -1119,12 +6116,11 @@ main(void) {
      * tally.
      */
 
-#if !defined(__SUNPRO_C) && !defined(__SUNPRO_CC) && !defined(__SUNPRO_CC_COMPAT)
-    /*NOTREACHED*/ /* unreachable */
     return 0;
-#endif /* if !defined(__SUNPRO_C) && !defined(__SUNPRO_CC) && !defined(__SUNPRO_CC_COMPAT) */
 }
 
+#endif /* ifndef TXTELITE_LIBRARY */
+
 /*
  * "Goat Soup" planetary description string code
  * adapted from Christian Pinder's reverse engineered sources.
@@ -1134,7 +6130,7 @@ struct desc_choice {
     const char *option[5];
 };
 
-static struct desc_choice desc_list[] = {
+static const struct desc_choice desc_list[] = {
     /* 81 */ {{"fabled", "notable", "well known", "famous", "noted"}},
     /* 82 */ {{"very ", "mildly ", "most ", "reasonably ", ""}},
     /* 83 */ {{"ancient", "\x95", "great", "vast", "pink"}},
@@ -1179,86 +6175,201 @@ static struct desc_choice desc_list[] = {
      */
 
 static int
-gen_rnd_number(void) {
+gen_rnd_number(fastseedtype *rnd_seed) {
     int a, x;
 
-    x = (rnd_seed.a * 2) & 0xFF;
-    a = x + rnd_seed.c;
-    if (rnd_seed.a > 127)
+    x = (rnd_seed->a * 2) & 0xFF;
+    a = x + rnd_seed->c;
+    if (rnd_seed->a > 127)
         a++;
 
-    rnd_seed.a = (uint8)(a & 0xFF);
-    rnd_seed.c = (uint8)x;
-    a          = a / 256; /* a = any carry left from above */
-    x          = rnd_seed.b;
-    a          = (a + x + rnd_seed.d) & 0xFF;
-    rnd_seed.b = (uint8)a;
-    rnd_seed.d = (uint8)x;
+    rnd_seed->a = (uint8)(a & 0xFF);
+    rnd_seed->c = (uint8)x;
+    a           = a / 256; /* a = any carry left from above */
+    x           = rnd_seed->b;
+    a           = (a + x + rnd_seed->d) & 0xFF;
+    rnd_seed->b = (uint8)a;
+    rnd_seed->d = (uint8)x;
     return a;
 }
 
 static void
-goat_soup(const char *source, plansys *psy) {
+descput(desctype *desc, int c) /* Append c, dropping what will not fit */
+{
+    if (desc->len + 1 < desc->size)
+        desc->buf[desc->len] = (char)c;
+
+    desc->len++;
+}
+
+static void
+descputs(desctype *desc, const char *s) {
+    while (*s != '\0') descput(desc, *(s++));
+}
+
+static void
+descwrite(desctype *desc, const char *s, size_t n) /* Append n bytes of s */
+{
+    if (desc->len + 1 < desc->size) {
+        size_t room = desc->size - 1 - desc->len;
+
+        (void)memcpy(desc->buf + desc->len, s, (n < room) ? n : room);
+    }
+
+    desc->len += n;
+}
+
+static boolean
+compileoption(souptype *soup, size_t *pc, const char *source)
+/*
+ * Append the code for one template at *pc; false if
+ * it does not fit
+ */
+{
+    uint8 *code = soup->code;
+
     for (;;) {
-        int c = (unsigned char)*(source++);
+        int c = (unsigned char)*source;
+        size_t n;
+
         if (c == '\0')
             break;
 
+        if (*pc + 1 + 0x7F + 1 > soupsize)
+            return false;
+
         if (c <= 0x80) {
-            (void)printf("%c", c);
+            n = 0;
+            while ((n < 0x7F) && (source[n] != '\0') && ((unsigned char)source[n] <= 0x80)) n++;
+
+            code[(*pc)++] = (uint8)n;
+            (void)memcpy(code + *pc, source, n);
+            *pc += n;
+            source += n;
+        } else if ((c <= 0xA4) || ((c >= 0xB0) && (c <= 0xB2))) {
+            code[(*pc)++] = (uint8)c;
+            source++;
         } else {
-            if (c <= 0xA4) {
-                int rnd = gen_rnd_number();
-                goat_soup(desc_list[c - 0x81].option[(rnd >= 0x33) + (rnd >= 0x66) + (rnd >= 0x99) + (rnd >= 0xCC)], psy);
-            } else {
-                switch (c) {
-                    case 0xB0: /* planet name */
-                    {
-                        int i = 1;
-                        (void)printf("%c", psy->name[0]);
-                        while (psy->name[i] != '\0')
-                            (void)printf("%c", tolower(psy->name[i++]));
-                    } break;
-
-                    case 0xB1: /* <planet name>ian */
-                    {
-                        int i = 1;
-                        (void)printf("%c", psy->name[0]);
-                        while (psy->name[i] != '\0') {
-                            if ((psy->name[i + 1] != '\0') || ((psy->name[i] != 'E') && (psy->name[i] != 'I')))
-                                (void)printf("%c", tolower(psy->name[i]));
-
-                            i++;
-                        }
-                        (void)printf("ian");
-                    } break;
-
-                    case 0xB2: /* random name */
-                    {
-                        int i;
-                        int len = gen_rnd_number() & 3;
-                        for (i = 0; i <= len; i++) {
-                            int x = gen_rnd_number() & 0x3e;
-                            char p1 = pairs[x];
-                            char p2 = pairs[x + 1];
-                            if (p1 != '.') {
-                                if (i)
-                                    p1 = (char)tolower(p1);
-
-                                (void)printf("%c", p1);
-                            }
-
-                            if (p2 != '.') {
-                                if (i || (p1 != '.'))
-                                    p2 = (char)tolower(p2);
-
-                                (void)printf("%c", p2);
-                            }
+            char bad[32];
+
+            (void)sprintf(bad, "<bad char in data [%X]>", c);
+            n = strlen(bad);
+            code[(*pc)++] = (uint8)n;
+            (void)memcpy(code + *pc, bad, n);
+            *pc += n;
+
+            break; /* Rest of this template is dropped */
+        }
+    }
+
+    code[(*pc)++] = 0;
+
+    return true;
+}
+
+static boolean
+compilesoup(souptype *soup)
+/*
+ * Compile desc_list and the description template;
+ * false if they do not fit in soupsize
+ */
+{
+    size_t pc = 0;
+    int x, k;
+
+    soup->root = 0;
+    if (!compileoption(soup, &pc, "\x8F is \x97."))
+        return false;
+
+    for (x = 0; x < soupchoices; x++) {
+        for (k = 0; k < 5; k++) {
+            soup->option[x][k] = (uint16)pc;
+            if (!compileoption(soup, &pc, desc_list[x].option[k]))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void
+expandsoup(const souptype *soup, fastseedtype *rnd_seed, const char *name, desctype *desc)
+/*
+ * Run the compiled description with an explicit stack
+ * of return addresses.  Templates nested deeper than
+ * soupdepth still draw their random number but are
+ * left out.
+ */
+{
+    const uint8 *stack[soupdepth];
+    const uint8 *pc = soup->code + soup->root;
+    int depth       = 0;
+    char lower[namelen], ian[namelen + 3]; /* Planet name, and <planet name>ian */
+    size_t lowerlen, ianlen, i;
+
+    lowerlen = 0;
+    ianlen   = 0;
+    if (name[0] != '\0') {
+        lower[lowerlen++] = name[0];
+        ian[ianlen++]     = name[0];
+        for (i = 1; name[i] != '\0'; i++) {
+            char c = (char)tolower(name[i]);
+
+            lower[lowerlen++] = c;
+            if ((name[i + 1] != '\0') || ((name[i] != 'E') && (name[i] != 'I')))
+                ian[ianlen++] = c;
+        }
+    }
+    (void)memcpy(ian + ianlen, "ian", 3);
+    ianlen += 3;
+
+    for (;;) {
+        int op = *(pc++);
+
+        if (op == 0) {
+            if (depth == 0)
+                break;
+
+            pc = stack[--depth];
+        } else if (op < 0x80) {
+            descwrite(desc, (const char *)pc, (size_t)op);
+            pc += op;
+        } else if (op <= 0xA4) {
+            int rnd = gen_rnd_number(rnd_seed);
+
+            if (depth < soupdepth) {
+                stack[depth++] = pc;
+                pc = soup->code + soup->option[op - 0x81][(rnd >= 0x33) + (rnd >= 0x66) + (rnd >= 0x99) + (rnd >= 0xCC)];
+            }
+        } else {
+            switch (op) {
+                case 0xB0: /* planet name */ descwrite(desc, lower, lowerlen); break;
+
+                case 0xB1: /* <planet name>ian */ descwrite(desc, ian, ianlen); break;
+
+                default: /* random name */
+                {
+                    int j;
+                    int len = gen_rnd_number(rnd_seed) & 3;
+                    for (j = 0; j <= len; j++) {
+                        int x   = gen_rnd_number(rnd_seed) & 0x3e;
+                        char p1 = pairs[x];
+                        char p2 = pairs[x + 1];
+                        if (p1 != '.') {
+                            if (j)
+                                p1 = (char)tolower(p1);
+
+                            descput(desc, p1);
                         }
-                    } break;
 
-                    default: (void)printf("<bad char in data [%X]>", c); return;
-                }
+                        if (p2 != '.') {
+                            if (j || (p1 != '.'))
+                                p2 = (char)tolower(p2);
+
+                            descput(desc, p2);
+                        }
+                    }
+                } break;
             }
         }
     }
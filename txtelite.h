@@ -0,0 +1,309 @@
+/* txtelite.h  1.5 */
+
+/* Embeddable interface to the Text Elite trading engine */
+
+/*
+ * Build with "make lib" to get libtxtelite.a and libtxtelite.so.
+ *
+ * Nothing here reads stdin or writes to stdout, and nothing
+ * here exits the host process.  All results are returned in
+ * the structures below.
+ *
+ * A universe is built once and is read-only afterwards, so
+ * one universe may be shared by any number of commanders
+ * running on any number of threads.  Each commander must be
+ * used by one thread at a time.  Native randomization uses
+ * libc rand(), which is global to the process; commanders
+ * that run concurrently should use the weak generator.
+ * libc's generator is only ever seeded by txtelite_seed
+ * with native set.
+ *
+ * Money is in tenths of a credit, fuel and distances are in
+ * tenths of a light year, as in the text interface.
+ */
+
+#ifndef TXTELITE_H
+# define TXTELITE_H
+
+# include <stddef.h>
+
+# ifdef __cplusplus
+extern "C" {
+# endif /* ifdef __cplusplus */
+
+# define TXTELITE_GALAXIES (8)
+# define TXTELITE_SYSTEMS  (256) /* Per galaxy */
+# define TXTELITE_GOODS    (17)
+# define TXTELITE_MAXPLAN  (32) /* Longest trade plan, in jumps */
+# define TXTELITE_SNAPSHOT (128) /* Bytes in a snapshot */
+
+/* Status codes */
+# define TXTELITE_OK           (0)
+# define TXTELITE_BADJUMP     (-1) /* Destination is the current system */
+# define TXTELITE_TOOFAR      (-2) /* Not enough fuel */
+# define TXTELITE_HOLDFULL    (-3) /* Cargo does not fit in new hold */
+# define TXTELITE_BADPLANET   (-4) /* System index out of range */
+# define TXTELITE_BADSNAPSHOT (-5) /* Not a snapshot, or from another byte order */
+# define TXTELITE_BADEXPORT   (-6) /* Not a whole export, or from another byte order */
+
+/* Route kinds */
+# define TXTELITE_HOPS (0) /* Fewest jumps, then least fuel */
+# define TXTELITE_FUEL (1) /* Least fuel, then fewest jumps */
+
+/* Trade good units */
+# define TXTELITE_TONNES    (0)
+# define TXTELITE_KILOGRAMS (1)
+# define TXTELITE_GRAMS     (2)
+
+typedef struct txtelite_universe txtelite_universe;
+typedef struct txtelite txtelite; /* One commander */
+
+typedef struct {
+    char name[12];
+    unsigned int x, y;
+    unsigned int economy; /* 0-7 */
+    unsigned int govtype; /* 0-7 */
+    unsigned int techlev; /* Displayed tech level is techlev+1 */
+    unsigned int population; /* Hundreds of millions */
+    unsigned int productivity;
+    unsigned int radius;
+    int human_colony;
+    unsigned int species_type;
+    unsigned int species_adj1;
+    unsigned int species_adj2;
+    unsigned int species_adj3;
+} txtelite_system;
+
+typedef struct {
+    unsigned int price[TXTELITE_GOODS]; /* Tenths of a credit per unit */
+    unsigned int quantity[TXTELITE_GOODS];
+} txtelite_market;
+
+typedef struct {
+    unsigned int galaxy;    /* 1-8 */
+    int planet;             /* 0-255 */
+    long cash;              /* Tenths of a credit */
+    unsigned int fuel;      /* Tenths of a light year */
+    unsigned int holdspace; /* Free tonnes */
+    unsigned int hold[TXTELITE_GOODS];
+    int quit;               /* Nonzero once the commander has quit */
+} txtelite_status;
+
+/*
+ * Worker threads for parallel builds and searches,
+ * when built with TXTELITE_THREADS; 0 (the default)
+ * means one per online processor.  Set before use.
+ */
+void txtelite_threads(int n);
+
+/* Universe */
+txtelite_universe *txtelite_universe_new(void);
+void txtelite_universe_free(txtelite_universe *u);
+
+/*
+ * Commanders start at Lave in galaxy one with a full tank,
+ * on the weak generator seeded with 12345
+ */
+txtelite *txtelite_new(const txtelite_universe *u);
+void txtelite_free(txtelite *t);
+
+/* Queries */
+void txtelite_status_get(const txtelite *t, txtelite_status *st);
+void txtelite_market_get(const txtelite *t, txtelite_market *m);
+int txtelite_market_at(const txtelite *t, int planet, unsigned int fluct, txtelite_market *m); /* Fresh market */
+int txtelite_system_get(const txtelite *t, int planet, txtelite_system *sys);
+int txtelite_generate(unsigned int galaxy, int planet, txtelite_system *sys);
+int txtelite_find(const txtelite *t, const char *name);
+unsigned int txtelite_distance(const txtelite *t, int a, int b);
+void txtelite_distances(const txtelite *t, int planet, unsigned int *out); /* TXTELITE_SYSTEMS of them */
+
+/*
+ * Spatial queries: fill out (and dist, if not NULL) with
+ * up to TXTELITE_SYSTEMS systems and return how many.
+ * within lists systems in range of planet in index order;
+ * near lists the k systems nearest map position (x,y),
+ * nearest first; x and y are clamped to the map, 0-255.
+ */
+int txtelite_within(const txtelite *t, int planet, unsigned int range, int *out, unsigned int *dist);
+int txtelite_near(const txtelite *t, int x, int y, int k, int *out, unsigned int *dist);
+
+/*
+ * Route between two systems within jump range of one
+ * another at each step: fills out with up to len systems,
+ * from and to included, and returns the full count; 0 if
+ * to cannot be reached.  The first route in a galaxy builds
+ * and caches its all-pairs table, so later ones cost only
+ * the length of the route.
+ */
+int txtelite_route(const txtelite *t, int from, int to, int kind, int *out, int len);
+
+/*
+ * Connectivity within jump range, precomputed per galaxy.
+ * component returns the lowest numbered system reachable
+ * from planet (a label shared by all of them) and stores
+ * how many there are, planet included, in *size if not
+ * NULL; reachable returns 1 if a and b are connected.
+ */
+int txtelite_component(const txtelite *t, int planet, unsigned int *size);
+int txtelite_reachable(const txtelite *t, int a, int b);
+
+/*
+ * The most profitable cargo to buy here, within cash and
+ * free hold, to sell at a typical market at dest: fills
+ * amounts (TXTELITE_GOODS of them) and *profit if not
+ * NULL.  Solved exactly; nothing is bought.
+ */
+int txtelite_bestbuy(const txtelite *t, int dest, unsigned int *amounts, long *profit);
+
+/*
+ * Best profit per tonne, in tenths of a credit, from one good
+ * sold by the tonne carried from one system to another within
+ * jump range, at typical markets; 0 if there is none, else the
+ * good is stored in *good if not NULL.  The first call in a
+ * galaxy builds and caches its whole matrix.
+ */
+int txtelite_arb(const txtelite *t, int from, int to, int *good);
+
+/*
+ * Plan a trading run of hops jumps from the current system,
+ * starting with cash and hold tonnes free and selling all
+ * cargo at each stop.  Markets after the first are taken to
+ * be typical for their economy.  The search widens until
+ * budget_ms milliseconds have passed.  Fills path with the
+ * systems visited, the current one first, and *final (if
+ * not NULL) with the estimated cash at the end; returns the
+ * jumps planned, fewer than hops if the way is blocked.
+ */
+int txtelite_plan(const txtelite *t, int hops, long cash, unsigned int hold, unsigned int budget_ms, int *path,
+                  long *final);
+
+size_t txtelite_describe(const txtelite *t, int planet, char *buf, size_t len);
+size_t txtelite_species(const txtelite *t, int planet, char *buf, size_t len);
+const char *txtelite_economy_name(unsigned int economy);
+const char *txtelite_government_name(unsigned int govtype);
+const char *txtelite_unit_name(unsigned int units);
+const char *txtelite_good_name(int good);
+unsigned int txtelite_good_units(int good);
+
+/*
+ * Simulation.  A policy is called at each stop of a
+ * commander: it buys any cargo and returns the system to
+ * jump to next, or -1 to stop.  Policies run on many
+ * threads at once, one commander each.  txtelite_random()
+ * draws from the commander's own random stream.
+ */
+typedef int (*txtelite_policy)(txtelite *t, void *arg);
+int txtelite_policy_random(txtelite *t, void *arg); /* Random system in range, best cargo for it */
+int txtelite_policy_greedy(txtelite *t, void *arg); /* System in range with the best cargo */
+unsigned int txtelite_random(txtelite *t);
+
+/*
+ * With the weak generator: the low bytes of the next n
+ * draws, as the fluctuation bytes of n jumps would be,
+ * and skipping n draws in O(log n) time
+ */
+void txtelite_random_bytes(txtelite *t, unsigned char *buf, size_t n);
+void txtelite_random_skip(txtelite *t, unsigned long n);
+
+/*
+ * Run commanders independent commanders of up to jumps
+ * jumps each, from the text interface's starting position,
+ * in parallel.  Fills profits (and made, the jumps each
+ * made, if not NULL), one per commander.  The weak
+ * generator's period of 2^31 draws is shared out: commander
+ * k uses it seeded with seed, skipped k*(2^31/commanders)
+ * draws, so no two commanders' streams overlap and results
+ * never depend on the number of threads.  A commander stops
+ * before a jump that would draw past the end of its share,
+ * counting what its policy draws with txtelite_random() and
+ * txtelite_random_bytes() or skips.
+ */
+int txtelite_simulate(const txtelite_universe *u, int commanders, int jumps, txtelite_policy policy, void *arg,
+                      unsigned long seed, long *profits, unsigned int *made);
+
+/*
+ * Snapshots of a commander's galaxy, planet, cash, fuel,
+ * hold, market and weak generator state, TXTELITE_SNAPSHOT
+ * bytes of fixed layout in host byte order.  save copies
+ * them into buf; restore copies them back from buf, which
+ * may be one of an array of snapshots in a mapped file, and
+ * leaves the commander alone if it is not a snapshot.  Both
+ * need buf aligned for an int.  Commanders using libc rand()
+ * carry on from wherever its stream is.
+ */
+void txtelite_save(const txtelite *t, void *buf);
+int txtelite_restore(txtelite *t, const void *buf);
+
+/*
+ * Universe export, written by "txtelite -export file": fixed
+ * width columns in host byte order, to be mapped and read in
+ * place.  A txtelite_export_head comes first, then a column
+ * directory, then the columns, each aligned to 8 bytes.
+ * Columns have one value per system, all 8 galaxies in
+ * index order, unless noted; "galaxy" counts from 1, as
+ * txtelite_status does, and "system" from 0.  A TXTELITE_STRING column has
+ * the offset of each system's string in the "heap" column,
+ * then one past the last; strings are NUL terminated.  The
+ * "market_price" and "market_quantity" columns hold every
+ * market by economy, good and fluctuation byte, fluctuation
+ * varying fastest; a system's market is its economy's.
+ *
+ * open checks an export of size bytes at data (aligned to 8,
+ * as a mapped file is) and fills x.  column finds a column
+ * by name and returns its values, storing its type and count
+ * if not NULL; NULL if there is none.  string returns the
+ * string of a system in a string column, storing its length
+ * in *len if not NULL; NULL if there is none.
+ */
+# define TXTELITE_EXPORT_MAGIC (0x54455831U) /* "TEX1" */
+
+/* Column types, by width in bytes */
+# define TXTELITE_U8     (1)
+# define TXTELITE_U16    (2)
+# define TXTELITE_U32    (4)
+# define TXTELITE_STRING (8) /* unsigned int offsets into "heap" */
+
+typedef struct {
+    unsigned int magic;
+    unsigned int columns; /* Directory entries */
+    unsigned int rows;    /* Systems */
+    unsigned int size;    /* Of the whole export */
+    unsigned int spare[4];
+} txtelite_export_head;
+
+typedef struct {
+    char name[16]; /* NUL padded */
+    unsigned int type;
+    unsigned int count;  /* Values */
+    unsigned int offset; /* From the start of the export */
+    unsigned int spare;
+} txtelite_column;
+
+typedef struct {
+    const unsigned char *base;
+    const txtelite_export_head *head;
+    const txtelite_column *column; /* Directory */
+} txtelite_export;
+
+int txtelite_export_open(txtelite_export *x, const void *data, size_t size);
+const void *txtelite_export_column(const txtelite_export *x, const char *name, unsigned int *type,
+                                   unsigned int *count);
+const char *txtelite_export_string(const txtelite_export *x, const char *name, unsigned int row, size_t *len);
+
+/* Actions */
+void txtelite_seed(txtelite *t, unsigned int seed, int native);
+unsigned int txtelite_buy(txtelite *t, int good, unsigned int amount);
+unsigned int txtelite_sell(txtelite *t, int good, unsigned int amount);
+unsigned int txtelite_fuel(txtelite *t, unsigned int amount);
+int txtelite_jump(txtelite *t, int planet);
+int txtelite_sneak(txtelite *t, int planet);
+void txtelite_galhyp(txtelite *t);
+int txtelite_hold(txtelite *t, unsigned int tonnes);
+void txtelite_cash(txtelite *t, long amount);
+void txtelite_quit(txtelite *t);
+
+# ifdef __cplusplus
+}
+# endif /* ifdef __cplusplus */
+
+#endif /* ifndef TXTELITE_H */